@@ -0,0 +1,238 @@
+// Spinlock microbenchmark.
+//
+// lockbench() acquires and releases one shared lock of the
+// given kind as fast as it can.  Run it from processes pinned
+// to different CPUs at once to compare the kinds' throughput
+// and fairness under contention; see lockbench.c.  Kind
+// BENCH_RW is a reader-writer lock taken to write only one
+// time in 64, to compare read-mostly use against the others.
+//
+// Kinds BENCH_PACKED and BENCH_PADDED take no lock: each CPU
+// increments a counter of its own, packed next to the other
+// CPUs' in one cache line or padded to a line apiece, to show
+// what false sharing costs.
+//
+// membench() times memmove, memset and memcmp on one buffer
+// size against the byte-at-a-time loops they replaced.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "spinlock.h"
+#include "rwlock.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "proc.h"
+
+#define BENCH_RW      NLOCKKIND
+#define BENCH_PACKED  (NLOCKKIND+1)
+#define BENCH_PADDED  (NLOCKKIND+2)
+#define NBENCH        (NLOCKKIND+3)
+
+// membench() kinds: each routine the old way, then the new.
+#define MB_OLDMOVE    0
+#define MB_MOVE       1
+#define MB_OLDSET     2
+#define MB_SET        3
+#define MB_OLDCMP     4
+#define MB_CMP        5
+#define NMEMBENCH     6
+
+static struct spinlock benchlocks[NLOCKKIND] = {
+  [LK_TAS]    { .name = "bench tas",    .kind = LK_TAS },
+  [LK_TICKET] { .name = "bench ticket", .kind = LK_TICKET },
+  [LK_MCS]    { .name = "bench mcs",    .kind = LK_MCS },
+};
+
+static struct rwlock benchrw = { .lock = { .name = "bench rw" } };
+
+static uint64 benchdata;  // Written under the lock, so its line moves too
+static uint64 benchsum;   // Keeps rwbench()'s reads
+
+static int
+rwbench(uint64 end)
+{
+  uint64 sum;
+  int n;
+
+  sum = 0;
+  for(n = 0; (n & 63) != 0 || nsec() < end; n++){
+    if((n & 63) == 0){
+      acquirewrite(&benchrw);
+      benchdata++;
+      releasewrite(&benchrw);
+    } else {
+      acquireread(&benchrw);
+      sum += benchdata;
+      releaseread(&benchrw);
+    }
+  }
+  benchsum = sum;
+  return n;
+}
+
+static volatile uint64 packed[NCPU];
+static struct {
+  volatile uint64 n;
+} __attribute__((aligned(CACHELINE))) padded[NCPU];
+
+static int
+sharebench(int pad, uint64 end)
+{
+  volatile uint64 *p;
+  int n;
+
+  // lockbench.c pins each caller to its own CPU.
+  pushcli();
+  p = pad ? &padded[cpu->id].n : &packed[cpu->id];
+  popcli();
+  for(n = 0; (n & 63) != 0 || nsec() < end; n++)
+    (*p)++;
+  return n;
+}
+
+// Hammer the kind lock for ms milliseconds and return
+// how many times this call acquired it.
+int
+lockbench(int kind, int ms)
+{
+  struct spinlock *lk;
+  uint64 end;
+  int n;
+
+  if(kind < 0 || kind >= NBENCH || ms <= 0 || ms > 10000)
+    return -1;
+  end = nsec() + ms * 1000000ULL;
+  if(kind == BENCH_RW)
+    return rwbench(end);
+  if(kind == BENCH_PACKED || kind == BENCH_PADDED)
+    return sharebench(kind == BENCH_PADDED, end);
+  lk = &benchlocks[kind];
+  for(n = 0; (n & 63) != 0 || nsec() < end; n++){
+    acquire(lk);
+    benchdata++;
+    release(lk);
+  }
+  return n;
+}
+
+// The string.c routines as they were, for comparison.
+static void
+oldmove(char *d, const char *s, uint n)
+{
+  if(s < d && s + n > d){
+    s += n;
+    d += n;
+    while(n-- > 0)
+      *--d = *--s;
+  } else
+    while(n-- > 0)
+      *d++ = *s++;
+}
+
+static void
+oldset(char *d, int c, uint n)
+{
+  while(n-- > 0)
+    *d++ = c;
+}
+
+static int
+oldcmp(const uchar *s1, const uchar *s2, uint n)
+{
+  while(n-- > 0){
+    if(*s1 != *s2)
+      return *s1 - *s2;
+    s1++, s2++;
+  }
+  return 0;
+}
+
+static int
+sign(int x)
+{
+  return x < 0 ? -1 : x > 0;
+}
+
+// Check the new routines against the old on every alignment
+// and on short, odd and page-sized lengths, overlapping
+// either way.  a and b are pages.
+static int
+memcheck(char *a, char *b)
+{
+  static int lens[] = { 0, 1, 7, 8, 9, 15, 16, 17, 63, 64, 65, 255, 1000 };
+  static int shifts[] = { -17, -9, -8, -1, 1, 3, 8, 9, 17 };
+  int i, j, off, sh, n, lo;
+
+  for(i = 0; i < PGSIZE; i++)
+    a[i] = b[i] = i * 7 + (i >> 8);
+  memmove(a, b, PGSIZE);
+  if(oldcmp((uchar*)a, (uchar*)b, PGSIZE) != 0)
+    return -1;
+
+  for(i = 0; i < NELEM(lens); i++){
+    n = lens[i];
+    for(off = 32; off < 40; off++){
+      lo = off - 32;
+      for(j = 0; j < NELEM(shifts); j++){
+        sh = shifts[j];
+        memmove(a + off + sh, a + off, n);
+        oldmove(b + off + sh, b + off, n);
+        if(oldcmp((uchar*)a + lo, (uchar*)b + lo, n + 64) != 0)
+          return -1;
+      }
+      memset(a + off, off, n);
+      oldset(b + off, off, n);
+      if(oldcmp((uchar*)a + lo, (uchar*)b + lo, n + 64) != 0)
+        return -1;
+      if(memcmp(a + off, b + off, n) != 0)
+        return -1;
+      if(n > 0){
+        b[off + n - 1]++;
+        if(sign(memcmp(a + off, b + off, n)) !=
+           sign(oldcmp((uchar*)a + off, (uchar*)b + off, n)))
+          return -1;
+        b[off + n - 1]--;
+      }
+    }
+  }
+  return 0;
+}
+
+// Run kind on n bytes for ms milliseconds
+// and return how many times it ran, after checking that the new
+// routines agree with the old.
+int
+membench(int kind, int n, int ms)
+{
+  char *a, *b;
+  uint64 end;
+  int i;
+
+  if(kind < 0 || kind >= NMEMBENCH || n < 0 || n > PGSIZE || ms <= 0 || ms > 10000)
+    return -1;
+  if((a = kalloc()) == 0)
+    return -1;
+  if((b = kalloc()) == 0){
+    kfree(a);
+    return -1;
+  }
+  i = -1;
+  if(memcheck(a, b) < 0)
+    goto out;
+  end = nsec() + ms * 1000000ULL;
+  for(i = 0; (i & 15) != 0 || nsec() < end; i++){
+    switch(kind){
+    case MB_OLDMOVE: oldmove(a, b, n); break;
+    case MB_MOVE:    memmove(a, b, n); break;
+    case MB_OLDSET:  oldset(a, i, n); break;
+    case MB_SET:     memset(a, i, n); break;
+    case MB_OLDCMP:  oldcmp((uchar*)a, (uchar*)a, n); break;
+    case MB_CMP:     memcmp(a, a, n); break;
+    }
+  }
+out:
+  kfree(a);
+  kfree(b);
+  return i;
+}
@@ -25,6 +25,7 @@
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "counter.h"
 
 struct {
   struct spinlock lock;
@@ -40,7 +41,7 @@ binit(void)
 {
   struct buf *b;
 
-  initlock(&bcache.lock, "bcache");
+  initlockkind(&bcache.lock, "bcache", LK_MCS);
 
 //PAGEBREAK!
   // Create linked list of buffers
@@ -70,6 +71,7 @@ bget(uint dev, uint blockno)
     if(b->dev == dev && b->blockno == blockno){
       b->refcnt++;
       release(&bcache.lock);
+      countinc(CNT_BHIT);
       acquiresleep(&b->lock);
       return b;
     }
@@ -85,6 +87,7 @@ bget(uint dev, uint blockno)
       b->flags = 0;
       b->refcnt = 1;
       release(&bcache.lock);
+      countinc(CNT_BMISS);
       acquiresleep(&b->lock);
       return b;
     }
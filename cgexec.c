@@ -0,0 +1,41 @@
+// cgexec shares quota cmd [arg...]
+// Run cmd in a new CPU group with the given share weight and
+// a quota of quota microseconds per 100 ms (0 for none), then
+// print how much CPU time the group used.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "cgroup.h"
+
+int
+main(int argc, char **argv)
+{
+  int id, pid;
+  struct cgstat st;
+
+  if(argc < 4){
+    printf(2, "usage: cgexec shares quota cmd [arg...]\n");
+    exit();
+  }
+  // Stay in the group until cmd is reaped, keeping it alive.
+  if((id = cgcreate(atoi(argv[1]), atoi(argv[2]), 0)) < 0){
+    printf(2, "cgexec: cannot create group\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(2, "cgexec: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    exec(argv[3], argv+3);
+    printf(2, "cgexec: exec %s failed\n", argv[3]);
+    exit();
+  }
+  waitpid(pid, 0);
+  if(cgstat(id, &st) == 0)
+    printf(1, "group %d: %d ms, throttled %d times\n",
+           id, (int)(st.usage / 1000000), (int)st.nthrottled);
+  exit();
+}
@@ -0,0 +1,252 @@
+// CPU groups: shares and quotas for sets of processes.
+//
+// Every process belongs to one group, inherited across fork()
+// and clone(); group 0 holds everything not moved elsewhere.
+// cgcreate() makes a group and moves the caller into it.  A group
+// goes away when its last member is freed.
+//
+// Shares divide the CPUs between groups that have work.  The
+// time a process runs is charged to its group's vtime, scaled
+// by CG_SHARES/shares, and pickproc() prefers processes of the
+// group with the least vtime.  A group that has been idle gets
+// at most VLAG of credit when it wakes.
+//
+// A quota caps the CPU time a group may use per period, summed
+// over all CPUs.  Once it is used up the group is throttled:
+// its processes stay RUNNABLE but are passed over until the
+// period ends.  Charges land when processes call sched(), at
+// least every tick, so a group can overrun by a tick per CPU.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "cgroup.h"
+
+#define VLAG  40000000  // ns of vtime credit for a waking group
+
+static struct spinlock cglock;
+static struct cgroup cgroups[NCGROUP];
+static uint64 vmax;       // Largest vtime charged so far
+int ncgthrottled;         // Throttled groups; see idle()
+
+void
+cginit(void)
+{
+  initlock(&cglock, "cgroup");
+  cgroups[0].inuse = 1;
+  cgroups[0].shares = CG_SHARES;
+  cgroups[0].period = CG_PERIOD * 1000ULL;
+}
+
+// Start a new period for g.  Caller must hold cglock.
+static void
+refill(struct cgroup *g, uint64 now)
+{
+  g->used = 0;
+  g->periodend = now + g->period;
+  if(g->throttled){
+    g->throttled = 0;
+    ncgthrottled--;
+  }
+}
+
+// Put np, a new child or thread of the current process,
+// in the current process's group, or in group 0 if there
+// is no current process.
+void
+cgfork(struct proc *np)
+{
+  acquire(&cglock);
+  np->cg = proc ? proc->cg : &cgroups[0];
+  np->cg->nproc++;
+  release(&cglock);
+}
+
+// Take p out of its group, freeing the group if p was its
+// last member.  Caller must hold cglock.
+static void
+leave(struct proc *p)
+{
+  struct cgroup *g;
+
+  g = p->cg;
+  p->cg = 0;
+  if(--g->nproc == 0 && g != &cgroups[0]){
+    if(g->throttled)
+      ncgthrottled--;
+    memset(g, 0, sizeof(*g));
+  }
+}
+
+// p is being freed.
+void
+cgfree(struct proc *p)
+{
+  if(p->cg == 0)
+    return;
+  acquire(&cglock);
+  leave(p);
+  release(&cglock);
+}
+
+// Move p into g.  Caller must hold cglock.
+static void
+enter(struct proc *p, struct cgroup *g)
+{
+  if(p->cg != g){
+    g->nproc++;
+    leave(p);
+    p->cg = g;
+  }
+}
+
+// Move p into group id.  Return -1 if there is no such group.
+int
+cgmove(struct proc *p, int id)
+{
+  struct cgroup *g;
+
+  if(id < 0 || id >= NCGROUP)
+    return -1;
+  acquire(&cglock);
+  g = &cgroups[id];
+  if(!g->inuse){
+    release(&cglock);
+    return -1;
+  }
+  enter(p, g);
+  release(&cglock);
+  return 0;
+}
+
+// Create a group with the given share weight and a quota of
+// quota microseconds per period microseconds (none if quota is
+// 0), and move the current process into it.  Return its id.
+int
+cgcreate(int shares, int quota, int period)
+{
+  struct cgroup *g;
+  int id;
+
+  if(shares <= 0 || shares > 100*CG_SHARES || quota < 0 || period < 0)
+    return -1;
+  if(period == 0)
+    period = CG_PERIOD;
+  if(quota > 0 && quota < 1000)  // less than a millisecond
+    return -1;
+
+  acquire(&cglock);
+  for(id = 1; id < NCGROUP; id++)
+    if(!cgroups[id].inuse)
+      break;
+  if(id == NCGROUP){
+    release(&cglock);
+    return -1;
+  }
+  g = &cgroups[id];
+  g->inuse = 1;
+  g->shares = shares;
+  g->quota = quota * 1000ULL;
+  g->period = period * 1000ULL;
+  g->periodend = nsec() + g->period;
+  g->vtime = vmax;
+  // Move in before dropping the lock, so that the new group
+  // is never seen in use with no members.
+  enter(proc, g);
+  release(&cglock);
+  return id;
+}
+
+// Copy the usage of group id to st.  Return -1 if there
+// is no such group.
+int
+cgstat(int id, struct cgstat *st)
+{
+  struct cgroup *g;
+
+  if(id < 0 || id >= NCGROUP)
+    return -1;
+  acquire(&cglock);
+  g = &cgroups[id];
+  if(!g->inuse){
+    release(&cglock);
+    return -1;
+  }
+  st->shares = g->shares;
+  st->nproc = g->nproc;
+  st->quota = g->quota;
+  st->period = g->period;
+  st->usage = g->usage;
+  st->nthrottled = g->nthrottled;
+  release(&cglock);
+  return 0;
+}
+
+// Charge p, which is leaving the CPU or yielding, for the
+// time it has run since it was last charged.
+// Caller must hold p->lock.
+void
+cgcharge(struct proc *p)
+{
+  struct cgroup *g;
+  uint64 now, ns;
+
+  now = nsec();
+  ns = now - p->chargeat;
+  p->chargeat = now;
+
+  acquire(&cglock);
+  g = p->cg;
+  g->usage += ns;
+  if(g->vtime + VLAG < vmax)
+    g->vtime = vmax - VLAG;
+  g->vtime += ns * CG_SHARES / g->shares;
+  if(g->vtime > vmax)
+    vmax = g->vtime;
+  if(g->quota){
+    if(now >= g->periodend)
+      refill(g, now);
+    g->used += ns;
+    if(g->used >= g->quota && !g->throttled){
+      g->throttled = 1;
+      g->nthrottled++;
+      ncgthrottled++;
+    }
+  }
+  release(&cglock);
+}
+
+// May processes of g run?  Ends the throttling of a group
+// whose period has run out.
+int
+cgrunnable(struct cgroup *g)
+{
+  uint64 now;
+
+  if(!g->throttled)
+    return 1;
+  now = nsec();
+  if(now < g->periodend)
+    return 0;
+  acquire(&cglock);
+  if(g->throttled && now >= g->periodend)
+    refill(g, now);
+  release(&cglock);
+  return 1;
+}
+
+// The vtime by which pickproc() orders g; see above.
+uint64
+cgvtime(struct cgroup *g)
+{
+  uint64 v;
+
+  v = g->vtime;
+  if(v + VLAG < vmax)
+    v = vmax - VLAG;
+  return v;
+}
@@ -0,0 +1,12 @@
+#define CG_SHARES  1024       // default share weight
+#define CG_PERIOD  100000     // default quota period (microseconds)
+
+// CPU group usage, as returned by cgstat().
+struct cgstat {
+  int shares;                 // Share weight
+  int nproc;                  // Member processes
+  uint64 quota;               // CPU time per period (ns), 0 if none
+  uint64 period;              // Quota period (ns)
+  uint64 usage;               // CPU time used by members (ns)
+  uint64 nthrottled;          // Periods in which the quota ran out
+};
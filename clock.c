@@ -0,0 +1,383 @@
+// Time keeping.
+//
+// The time stamp counter, calibrated against the PIT at boot,
+// gives a monotonic nanosecond clock.  Each CPU runs its local
+// APIC timer in one-shot mode, armed for the earliest of its next
+// scheduling tick, its first nanosleep() deadline, and the next
+// slot in its timer wheel that holds a timer.
+//
+// The timer wheel keeps tick-granularity timers (sleep() and
+// kernel timeouts).  It is hierarchical: level 0 has one slot per
+// tick for the next WHEELSIZE ticks, and each higher level has
+// slots WHEELSIZE times as wide.  Adding or removing a timer is
+// O(1).  Each time the wheel's clock crosses a slot boundary of
+// level n, it moves that slot's timers down into level n-1.
+// Level 0 expiry wakes only the timers that are due.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "x86.h"
+#include "timer.h"
+
+#define TICKNS    10000000  // nanoseconds per scheduling tick
+
+// 8253/8254 programmable interval timer, channel 2.
+#define PIT_HZ    1193182
+#define PIT_CH2   0x42
+#define PIT_CMD   0x43
+#define PIT_GATE  0x61      // channel 2 gate and output
+#define CALMS     10        // calibration interval in milliseconds
+
+#define WHEELBITS 6
+#define WHEELSIZE (1 << WHEELBITS)
+#define WHEELMASK (WHEELSIZE - 1)
+#define NLEVEL    4         // wheel spans WHEELSIZE^NLEVEL ticks
+
+uint tsckhz;                // TSC cycles per millisecond
+static uint64 tsc0;         // TSC at boot
+
+// A thread in nanosleep().  Lives on its kernel stack.
+struct sleeper {
+  uint64 deadline;
+  int done;
+  struct sleeper *next;
+};
+
+// Per-CPU timer state.
+struct clock {
+  struct spinlock lock;
+  struct sleeper *sleepers;  // sorted by deadline
+  uint64 nexttick;           // time of the next scheduling tick
+  int tickoff;               // tick stopped by clocktick(0)
+  uint64 clk;                // next tick the wheel will expire
+  int ntimers;               // timers in the wheel
+  struct timer *wheel[NLEVEL][WHEELSIZE];
+};
+
+static struct clock clocks[NCPU];
+
+void
+clockinit(void)
+{
+  struct clock *c;
+  uint latch;
+  uint64 t0, t1;
+
+  for(c = clocks; c < clocks+NCPU; c++)
+    initlock(&c->lock, "clock");
+
+  // Count TSC cycles while PIT channel 2 counts down CALMS ms.
+  // In mode 0 its output rises when the count reaches zero.
+  latch = PIT_HZ / 1000 * CALMS;
+  outb(PIT_GATE, (inb(PIT_GATE) & ~0x02) | 0x01);  // gate on, speaker off
+  outb(PIT_CMD, 0xB0);  // channel 2, low then high byte, mode 0
+  outb(PIT_CH2, latch & 0xFF);
+  outb(PIT_CH2, latch >> 8);
+  t0 = rdtsc();
+  while((inb(PIT_GATE) & 0x20) == 0)
+    ;
+  t1 = rdtsc();
+  tsckhz = (t1 - t0) / CALMS;
+  tsc0 = t1;
+}
+
+// Nanoseconds since clockinit().
+uint64
+nsec(void)
+{
+  uint64 c;
+
+  c = rdtsc() - tsc0;
+  return c / tsckhz * 1000000 + c % tsckhz * 1000000 / tsckhz;
+}
+
+// Ticks since clockinit().
+uint64
+clockticks(void)
+{
+  return nsec() / TICKNS;
+}
+
+// Put t in the slot of c's wheel for t->expires.  A timer
+// beyond the wheel's span goes in the farthest slot of the top
+// level; when that slot cascades, wheelrun() adds it again,
+// nearer, until it fits.
+// Caller must hold c->lock.
+static void
+wheeladd(struct clock *c, struct timer *t)
+{
+  struct timer **slot;
+  uint64 delta, at;
+  int lvl;
+
+  if(t->expires < c->clk)
+    t->expires = c->clk;
+  at = t->expires;
+  delta = at - c->clk;
+  if(delta >= (uint64)1 << (WHEELBITS*NLEVEL)){
+    delta = ((uint64)1 << (WHEELBITS*NLEVEL)) - 1;
+    at = c->clk + delta;
+  }
+  for(lvl = 0; delta >= (uint64)1 << (WHEELBITS*(lvl+1)); lvl++)
+    ;
+  slot = &c->wheel[lvl][(at >> (WHEELBITS*lvl)) & WHEELMASK];
+  t->next = *slot;
+  if(t->next)
+    t->next->pprev = &t->next;
+  t->pprev = slot;
+  *slot = t;
+  c->ntimers++;
+}
+
+// Take t out of its wheel slot.
+// Caller must hold the lock of t's clock.
+static void
+wheeldel(struct clock *c, struct timer *t)
+{
+  *t->pprev = t->next;
+  if(t->next)
+    t->next->pprev = t->pprev;
+  t->next = 0;
+  t->pprev = 0;
+  c->ntimers--;
+}
+
+// Advance c's wheel through tick now, running due timers.
+static void
+wheelrun(struct clock *c, uint64 now)
+{
+  struct timer *t;
+  int lvl, idx;
+
+  if(c->ntimers == 0){
+    if(c->clk <= now)
+      c->clk = now + 1;
+    return;
+  }
+  while(c->clk <= now){
+    // Crossing a level-0 rotation: move the timers in the
+    // current slot of each higher level down the wheel.
+    if((c->clk & WHEELMASK) == 0){
+      for(lvl = 1; lvl < NLEVEL; lvl++){
+        idx = (c->clk >> (WHEELBITS*lvl)) & WHEELMASK;
+        while((t = c->wheel[lvl][idx]) != 0){
+          wheeldel(c, t);
+          wheeladd(c, t);
+        }
+        if(idx != 0)
+          break;
+      }
+    }
+    idx = c->clk & WHEELMASK;
+    c->clk++;
+    while((t = c->wheel[0][idx]) != 0){
+      wheeldel(c, t);
+      t->fn(t->arg);
+    }
+  }
+}
+
+// Tick at which c's wheel next needs attention: the first
+// non-empty level-0 slot, or the start of the next rotation,
+// when higher levels cascade.  Return 0 if the wheel is empty.
+static uint64
+wheelnext(struct clock *c)
+{
+  uint64 i;
+
+  if(c->ntimers == 0)
+    return 0;
+  for(i = c->clk; ; i++)
+    if((i & WHEELMASK) == 0 || c->wheel[0][i & WHEELMASK])
+      return i;
+}
+
+// Program this CPU's timer for the earliest of the next tick,
+// the first sleeper's deadline, and the next wheel slot due.
+// Caller must hold c->lock and be running on c's CPU.
+static void
+clockarm(struct clock *c, uint64 now)
+{
+  uint64 next, w;
+
+  next = c->tickoff ? 0 : c->nexttick;
+  if(c->sleepers && (next == 0 || c->sleepers->deadline < next))
+    next = c->sleepers->deadline;
+  if((w = wheelnext(c)) != 0 && (next == 0 || w*TICKNS < next))
+    next = w*TICKNS;
+  if(next == 0)
+    lapicarm(0);
+  else
+    lapicarm(next > now ? next - now : 1);
+}
+
+// Timer interrupt on this CPU.  Run timers and wake
+// sleepers that are due, then re-arm the timer.
+void
+clockintr(void)
+{
+  struct clock *c;
+  struct sleeper *s;
+  uint64 now;
+
+  c = &clocks[cpu->id];
+  acquire(&c->lock);
+  now = nsec();
+  if(!c->tickoff && now >= c->nexttick){
+    c->nexttick += TICKNS;
+    if(c->nexttick <= now)
+      c->nexttick = now + TICKNS;
+  }
+  wheelrun(c, now / TICKNS);
+  while((s = c->sleepers) != 0 && s->deadline <= now){
+    c->sleepers = s->next;
+    s->done = 1;
+    wakeup(s);
+  }
+  clockarm(c, now);
+  release(&c->lock);
+}
+
+// Stop (on == 0) or restart this CPU's scheduling tick.
+// Idle CPUs stop it while halted; timers and nanosleep()
+// deadlines queued here still interrupt them.
+// Caller must have interrupts disabled.
+void
+clocktick(int on)
+{
+  struct clock *c;
+  uint64 now;
+
+  c = &clocks[cpu->id];
+  acquire(&c->lock);
+  now = nsec();
+  c->tickoff = !on;
+  if(on)
+    c->nexttick = now + TICKNS;
+  clockarm(c, now);
+  release(&c->lock);
+}
+
+// Call t->fn(t->arg) from the timer interrupt on this CPU
+// after n ticks.  fn runs with interrupts off and the clock
+// lock held: it may call wakeup() but not timeradd() or
+// timerdel().  t must not already be pending.
+void
+timeradd(struct timer *t, uint n)
+{
+  struct clock *c;
+
+  pushcli();
+  t->cpu = cpu->id;
+  c = &clocks[t->cpu];
+  acquire(&c->lock);
+  popcli();
+  t->expires = clockticks() + n;
+  wheeladd(c, t);
+  if(c->tickoff)
+    clockarm(c, nsec());
+  release(&c->lock);
+}
+
+// Cancel t.  Return 1 if it was pending, 0 if it has
+// already run or was never added.
+int
+timerdel(struct timer *t)
+{
+  struct clock *c;
+  int pending;
+
+  // t->cpu means nothing until t has been added.
+  if(t->pprev == 0)
+    return 0;
+  c = &clocks[t->cpu];
+  acquire(&c->lock);
+  pending = t->pprev != 0;
+  if(pending)
+    wheeldel(c, t);
+  release(&c->lock);
+  return pending;
+}
+
+static void
+timerwakeup(void *chan)
+{
+  wakeup(chan);
+}
+
+// Sleep for n ticks.  Return -1 if killed while sleeping.
+int
+ticksleep(uint n)
+{
+  struct clock *c;
+  struct timer t;
+
+  if(n == 0)
+    return 0;
+
+  pushcli();
+  c = &clocks[cpu->id];
+  acquire(&c->lock);
+  popcli();
+
+  t.cpu = c - clocks;
+  t.fn = timerwakeup;
+  t.arg = &t;
+  t.expires = clockticks() + n;
+  wheeladd(c, &t);
+
+  while(t.pprev){
+    if(proc->killed){
+      wheeldel(c, &t);
+      release(&c->lock);
+      return -1;
+    }
+    sleep(&t, &c->lock);
+  }
+  release(&c->lock);
+  return 0;
+}
+
+// Sleep for ns nanoseconds.  The deadline is queued on
+// the current CPU, whose timer will fire for it.
+// Return -1 if killed while sleeping.
+int
+nanosleep(uint64 ns)
+{
+  struct clock *c;
+  struct sleeper s, **pp;
+
+  pushcli();
+  c = &clocks[cpu->id];
+  acquire(&c->lock);
+  popcli();
+
+  s.deadline = nsec() + ns;
+  if(s.deadline < ns)
+    s.deadline = ~(uint64)0;
+  s.done = 0;
+  for(pp = &c->sleepers; *pp && (*pp)->deadline <= s.deadline; pp = &(*pp)->next)
+    ;
+  s.next = *pp;
+  *pp = &s;
+  if(c->sleepers == &s)
+    clockarm(c, nsec());
+
+  while(!s.done){
+    if(proc->killed){
+      for(pp = &c->sleepers; *pp != &s; pp = &(*pp)->next)
+        ;
+      *pp = s.next;
+      release(&c->lock);
+      return -1;
+    }
+    sleep(&s, &c->lock);
+  }
+  release(&c->lock);
+  return 0;
+}
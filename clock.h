@@ -0,0 +1,6 @@
+#define CLOCK_MONOTONIC  1   // time since boot
+
+struct timespec {
+  long tv_sec;
+  long tv_nsec;
+};
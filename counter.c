@@ -0,0 +1,84 @@
+// Per-CPU statistics counters.
+//
+// The counters are a __thread array, so every CPU has a copy
+// in the local storage page that seginit() points %fs at,
+// PGSIZE/2 bytes in; countinc() and countadd() bump this CPU's
+// copy.  Reading a counter sums the copies of all CPUs, without
+// a lock: a CPU counting meanwhile may or may not be included.
+//
+// __thread variables must stay zero-initialized (there is no
+// .tdata image to copy) and all of them must fit between the
+// TSS and the middle of the page.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "counter.h"
+
+// Named only inside countinc()'s asm, which LTO cannot see.
+__thread uint64 cpucounts[NCOUNTER] __attribute__((used));
+
+static char *names[NCOUNTER] = {
+[CNT_SYSCALL] "syscall",
+[CNT_INTR]    "intr",
+[CNT_PREEMPT] "preempt",
+[CNT_SWITCH]  "switch",
+[CNT_IDLE]    "idle",
+[CNT_KALLOC]  "kalloc",
+[CNT_KFREE]   "kfree",
+[CNT_BHIT]    "bcache hit",
+[CNT_BMISS]   "bcache miss",
+};
+
+// Return c's copy of counter i, or 0 if c has not started.
+static uint64*
+slot(struct cpu *c, int i)
+{
+  addr_t off;
+
+  if(c->local == 0)
+    return 0;
+  asm("movq $cpucounts@tpoff, %0" : "=r" (off));
+  return (uint64*)((char*)c->local + PGSIZE/2 + off) + i;
+}
+
+// Return counter i summed over all CPUs.
+uint64
+countsum(int i)
+{
+  uint64 *p, n;
+  int c;
+
+  n = 0;
+  for(c = 0; c < ncpu; c++)
+    if((p = slot(&cpus[c], i)) != 0)
+      n += *(volatile uint64*)p;
+  return n;
+}
+
+// Copy the first n counters to st, then clear them all if
+// reset is set.  Return the number of counters.
+int
+counterstat(struct counter *st, int n, int reset)
+{
+  uint64 *p;
+  int i, c;
+
+  if(n > NCOUNTER)
+    n = NCOUNTER;
+  for(i = 0; i < n; i++){
+    memset(&st[i], 0, sizeof(st[i]));
+    safestrcpy(st[i].name, names[i], sizeof(st[i].name));
+    st[i].value = countsum(i);
+  }
+  if(reset)
+    for(c = 0; c < ncpu; c++)
+      for(i = 0; i < NCOUNTER; i++)
+        if((p = slot(&cpus[c], i)) != 0)
+          *(volatile uint64*)p = 0;
+  return NCOUNTER;
+}
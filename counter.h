@@ -0,0 +1,28 @@
+// Per-CPU statistics counters; see counter.c.
+
+#define CNT_SYSCALL   0  // System calls
+#define CNT_INTR      1  // Device and IPI interrupts
+#define CNT_PREEMPT   2  // Processes preempted by tick or IPI
+#define CNT_SWITCH    3  // Processes switched to
+#define CNT_IDLE      4  // Halts with nothing to run
+#define CNT_KALLOC    5  // Pages allocated
+#define CNT_KFREE     6  // Pages freed
+#define CNT_BHIT      7  // Block lookups found in the buffer cache
+#define CNT_BMISS     8  // Block lookups that recycled a buffer
+#define NCOUNTER      9
+
+// As returned by counters().
+struct counter {
+  char name[16];
+  uint64 value;        // Summed over all CPUs
+};
+
+// Each CPU's counts live in its own local storage page, so
+// bumping one is a single unlocked instruction that no other
+// CPU's cache line shares, and preemption cannot split it.
+extern __thread uint64 cpucounts[NCOUNTER];
+
+#define countinc(i) \
+  asm volatile("incq %%fs:cpucounts@tpoff(,%0,8)" : : "r"((addr_t)(i)))
+#define countadd(i, n) \
+  asm volatile("addq %1, %%fs:cpucounts@tpoff(,%0,8)" : : "r"((addr_t)(i)), "r"((uint64)(n)))
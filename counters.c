@@ -0,0 +1,43 @@
+// counters [cmd [arg...]]
+// Print the kernel's statistics counters, summed over all
+// CPUs.  With a command, clear them, run the command, and
+// print what it accumulated.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "counter.h"
+
+struct counter st[NCOUNTER];
+
+int
+main(int argc, char **argv)
+{
+  int i, j, n, pid;
+
+  if(argc > 1){
+    counters(st, 0, 1);
+    pid = fork();
+    if(pid < 0){
+      printf(2, "counters: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      exec(argv[1], argv+1);
+      printf(2, "counters: exec %s failed\n", argv[1]);
+      exit();
+    }
+    wait();
+  }
+
+  n = counters(st, NCOUNTER, 0);
+  if(n > NCOUNTER)
+    n = NCOUNTER;
+  for(i = 0; i < n; i++){
+    printf(1, "%s", st[i].name);
+    for(j = strlen(st[i].name); j < 16; j++)
+      printf(1, " ");
+    printf(1, "%d\n", (int)st[i].value);
+  }
+  exit();
+}
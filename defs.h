@@ -1,32 +1,73 @@
 struct buf;
+struct cgroup;
+struct cgstat;
 struct context;
+struct counter;
 struct file;
 struct inode;
+struct lockclass;
+struct lockstat;
 struct pipe;
 struct proc;
 struct rtcdate;
+struct rwlock;
+struct schedstat;
 struct spinlock;
 struct sleeplock;
 struct stat;
 struct superblock;
+struct timer;
+struct work;
 
 //entry.S
 void wrmsr(uint msr, uint64 val);
 void syscall_entry(void);
 void ignore_sysret(void);
 
+// bench.c
+int             lockbench(int, int);
+int             membench(int, int, int);
+
 // bio.c
 void            binit(void);
 struct buf*     bread(uint, uint);
 void            brelse(struct buf*);
 void            bwrite(struct buf*);
 
+// cgroup.c
+void            cgcharge(struct proc*);
+int             cgcreate(int, int, int);
+void            cgfork(struct proc*);
+void            cgfree(struct proc*);
+void            cginit(void);
+int             cgmove(struct proc*, int);
+int             cgrunnable(struct cgroup*);
+int             cgstat(int, struct cgstat*);
+uint64          cgvtime(struct cgroup*);
+extern int      ncgthrottled;
+
+// clock.c
+void            clockinit(void);
+void            clockintr(void);
+void            clocktick(int);
+uint64          clockticks(void);
+int             nanosleep(uint64);
+uint64          nsec(void);
+int             ticksleep(uint);
+void            timeradd(struct timer*, uint);
+int             timerdel(struct timer*);
+extern uint     tsckhz;
+
 // console.c
 void            consoleinit(void);
 void            cprintf(char*, ...);
 void            consoleintr(int(*)(void));
 void            panic(char*) __attribute__((noreturn));
 
+// counter.c
+int             counterstat(struct counter*, int, int);
+uint64          countsum(int);
+
 // exec.c
 int             exec(char*, char**);
 
@@ -34,11 +75,21 @@ int             exec(char*, char**);
 struct file*    filealloc(void);
 void            fileclose(struct file*);
 struct file*    filedup(struct file*);
+struct file*    fileget(struct file**);
 void            fileinit(void);
 int             fileread(struct file*, char*, int n);
 int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
 
+// fpu.c
+void            fpuexec(void);
+int             fpufork(struct proc*);
+void            fpufree(struct proc*);
+void            fpuinit(void);
+void            fpuleave(struct proc*);
+void            fpuswitch(struct proc*);
+int             fputrap(void);
+
 // fs.c
 void            readsb(int dev, struct superblock *sb);
 int             dirlink(struct inode*, char*, uint);
@@ -52,12 +103,17 @@ void            iunlock(struct inode*);
 void            iunlockput(struct inode*);
 void            iupdate(struct inode*);
 int             namecmp(const char*, const char*);
+void            ncremove(struct inode*, char*);
 struct inode*   namei(char*);
 struct inode*   nameiparent(char*, char*);
 int             readi(struct inode*, char*, uint, uint);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
 
+// futex.c
+int             futex(addr_t, int, int);
+void            futexinit(void);
+
 // ide.c
 void            ideinit(void);
 void            ideintr(void);
@@ -81,11 +137,19 @@ void            kbdintr(void);
 void            cmostime(struct rtcdate *r);
 int             cpunum(void);
 extern volatile uint*    lapic;
+void            lapicarm(uint64);
 void            lapiceoi(void);
 void            lapicinit(void);
+void            lapicipi(uchar, int);
 void            lapicstartap(uchar, uint);
 void            microdelay(int);
 
+// lockprof.c
+struct lockclass* lockclass(char*);
+void            lockacquired(struct spinlock*, uint64, addr_t);
+void            lockreleased(struct spinlock*);
+int             lockstat(struct lockstat*, int, int);
+
 // log.c
 void            initlog(int dev);
 void            log_write(struct buf*);
@@ -104,33 +168,73 @@ int             pipewrite(struct pipe*, char*, int);
 
 //PAGEBREAK: 16
 // proc.c
+int             clone(addr_t, addr_t, addr_t, addr_t);
 void            exit(void);
 int             fork(void);
+int             getaffinity(int);
 int             growproc(int);
+int             join(addr_t*);
 int             kill(int);
+struct proc*    kthread(char*, void (*)(void*), void*, uint);
 void            pinit(void);
 void            procdump(void);
 void            scheduler(void) __attribute__((noreturn));
+int             setaffinity(int, uint);
+int             setcgroup(int, int);
 void            sched(void);
+int             schedstat(struct schedstat*, int, int);
 void            sleep(void*, struct spinlock*);
+void            sleeplockstat(int);
 void            userinit(void);
 int             wait(void);
+int             waitpid(int, int);
 void            wakeup(void*);
+void            wakeupsync(void*);
 void            yield(void);
 
+// rcu.c
+void            rcuinit(void);
+int             rcudone(uint64);
+void            rcuqs(void);
+void            rcureadlock(void);
+void            rcureadunlock(void);
+uint64          rcustart(void);
+void            rcusync(void);
+
+// workq.c
+int             queuework(struct work*);
+int             queueworkon(int, struct work*);
+void            workqinit(void);
+
 // swtch.S
 void            swtch(struct context**, struct context*);
 
+// smpcall.c
+void            smpcall(int, void(*)(void*), void*);
+void            smpcallinit(void);
+void            smpcallintr(void);
+
 // spinlock.c
 void            acquire(struct spinlock*);
 void            getcallerpcs(void*, addr_t*);
 void		getstackpcs(addr_t*, addr_t*);
 int             holding(struct spinlock*);
+int             tryacquire(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+void            initlockkind(struct spinlock*, char*, int);
 void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
 
+// rwlock.c
+void            acquireread(struct rwlock*);
+void            acquirewrite(struct rwlock*);
+int             holdingread(struct rwlock*);
+int             holdingwrite(struct rwlock*);
+void            initrwlock(struct rwlock*, char*);
+void            releaseread(struct rwlock*);
+void            releasewrite(struct rwlock*);
+
 // sleeplock.c
 void            acquiresleep(struct sleeplock*);
 void            releasesleep(struct sleeplock*);
@@ -145,6 +249,7 @@ char*           safestrcpy(char*, const char*, int);
 int             strlen(const char*);
 int             strncmp(const char*, const char*, uint);
 char*           strncpy(char*, const char*, int);
+void            stringinit(void);
 
 // syscall.c
 void		syscall(void);
@@ -160,9 +265,7 @@ int		fetchint(addr_t, int*);
 
 // trap.c
 void            idtinit(void);
-extern uint     ticks;
 void            tvinit(void);
-extern struct spinlock tickslock;
 
 // uart.c
 void		uartearlyinit(void);
@@ -177,6 +280,8 @@ pde_t*          setupkvm(void);
 char*           uva2ka(pde_t*, char*);
 int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint64, uint64);
+void            unmapuvm(pde_t*, uint64, uint64);
+void            freeuvm(pde_t*, uint64, uint64);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
 int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
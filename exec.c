@@ -2,6 +2,7 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "defs.h"
 #include "x86.h"
@@ -18,6 +19,10 @@ exec(char *path, char **argv)
   struct proghdr ph;
   pde_t *pgdir, *oldpgdir;
 
+  // Other threads would be left running in the old image.
+  if(proc->leader != proc || proc->nthreads > 1)
+    return -1;
+
   oldpgdir = proc->pgdir;
 
   begin_op();
@@ -102,6 +107,8 @@ exec(char *path, char **argv)
   proc->tf->rip = elf.entry;  // main
   proc->tf->rcx = elf.entry;
   proc->tf->rsp = sp;
+  proc->tls = 0;
+  fpuexec();
   switchuvm(proc);
   freevm(oldpgdir);
   return 0;
@@ -7,19 +7,25 @@
 #include "param.h"
 #include "fs.h"
 #include "spinlock.h"
+#include "rwlock.h"
 #include "sleeplock.h"
 #include "file.h"
 
 struct devsw devsw[NDEV];
+
+// Only filealloc() writes ftable.lock, to claim a free file.
+// Reference counts change atomically under a read hold, which
+// is enough to keep filealloc() from seeing a count pass
+// through zero.
 struct {
-  struct spinlock lock;
+  struct rwlock lock;
   struct file file[NFILE];
 } ftable;
 
 void
 fileinit(void)
 {
-  initlock(&ftable.lock, "ftable");
+  initrwlock(&ftable.lock, "ftable");
 }
 
 // Allocate a file structure.
@@ -28,15 +34,15 @@ filealloc(void)
 {
   struct file *f;
 
-  acquire(&ftable.lock);
+  acquirewrite(&ftable.lock);
   for(f = ftable.file; f < ftable.file + NFILE; f++){
     if(f->ref == 0){
       f->ref = 1;
-      release(&ftable.lock);
+      releasewrite(&ftable.lock);
       return f;
     }
   }
-  release(&ftable.lock);
+  releasewrite(&ftable.lock);
   return 0;
 }
 
@@ -44,11 +50,34 @@ filealloc(void)
 struct file*
 filedup(struct file *f)
 {
-  acquire(&ftable.lock);
+  acquireread(&ftable.lock);
   if(f->ref < 1)
     panic("filedup");
-  f->ref++;
-  release(&ftable.lock);
+  __sync_fetch_and_add(&f->ref, 1);
+  releaseread(&ftable.lock);
+  return f;
+}
+
+// Take a reference to the file in the descriptor slot *fp.
+// Return 0 if the slot is empty or another thread has just
+// dropped the last reference to its file.  The read hold
+// keeps filealloc() from reusing the file meanwhile.
+struct file*
+fileget(struct file **fp)
+{
+  struct file *f;
+  int ref;
+
+  acquireread(&ftable.lock);
+  if((f = *fp) != 0){
+    do {
+      if((ref = f->ref) < 1){
+        f = 0;
+        break;
+      }
+    } while(!__sync_bool_compare_and_swap(&f->ref, ref, ref + 1));
+  }
+  releaseread(&ftable.lock);
   return f;
 }
 
@@ -58,17 +87,16 @@ fileclose(struct file *f)
 {
   struct file ff;
 
-  acquire(&ftable.lock);
+  acquireread(&ftable.lock);
   if(f->ref < 1)
     panic("fileclose");
-  if(--f->ref > 0){
-    release(&ftable.lock);
+  if(__sync_sub_and_fetch(&f->ref, 1) > 0){
+    releaseread(&ftable.lock);
     return;
   }
   ff = *f;
-  f->ref = 0;
   f->type = FD_NONE;
-  release(&ftable.lock);
+  releaseread(&ftable.lock);
 
   if(ff.type == FD_PIPE)
     pipeclose(ff.pipe, ff.writable);
@@ -126,11 +154,12 @@ filewrite(struct file *f, char *addr, int n)
   if(f->type == FD_INODE){
     // write a few blocks at a time to avoid exceeding
     // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((LOGSIZE-1-1-2) / 2) * 512;
+    // i-node, indirect and double-indirect blocks,
+    // allocation blocks, and 2 blocks of slop for
+    // non-aligned writes.  this really belongs lower
+    // down, since writei() might be writing a device
+    // like the console.
+    int max = ((LOGSIZE-1-1-1-2) / 2) * 512;
     int i = 0;
     while(i < n){
       int n1 = n - i;
@@ -0,0 +1,189 @@
+// Lazy FPU, SSE and AVX state switching.
+//
+// A process gets a save area the first time it uses the FPU.
+// Switching to a process whose state is not in this CPU's
+// registers sets CR0.TS, so its first FPU instruction traps
+// (#NM) and fputrap() loads the state.  Switching away from the
+// process whose state is loaded saves it with XSAVEOPT, which
+// skips components not modified since they were restored, so
+// the saved copy is always current and any CPU can load it.
+// The kernel itself is compiled not to touch these registers.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "x86.h"
+
+#define CPUID_XSAVE  (1 << 26)   // CPUID.1:ECX
+#define XSAVEOPT     0x1         // CPUID.(0xD,1):EAX
+
+// XCR0 state components.
+#define XCR0_X87     0x1
+#define XCR0_SSE     0x2
+#define XCR0_AVX     0x4
+
+#define FXSAVESIZE   512
+
+static int usexsave;     // XSAVE/XRSTOR, else FXSAVE/FXRSTOR
+static int usexsaveopt;
+static uint64 xcr0;      // components to save
+static uint fpusize;     // bytes used in a save area
+
+// Enable the FPU and SSE (and AVX, with XSAVE) for user code
+// on this CPU.  CR0.TS starts set: nothing is loaded yet.
+void
+fpuinit(void)
+{
+  uint a, b, c, d;
+
+  cpuid(1, 0, &a, &b, &c, &d);
+  usexsave = (c & CPUID_XSAVE) != 0;
+  lcr4(rcr4() | CR4_OSXFSR | CR4_OSXMMEXCPT | (usexsave ? CR4_OSXSAVE : 0));
+  if(usexsave){
+    cpuid(0xD, 0, &a, &b, &c, &d);
+    xcr0 = XCR0_X87 | XCR0_SSE | (a & XCR0_AVX);
+    xsetbv(0, xcr0);
+    cpuid(0xD, 0, &a, &b, &c, &d);  // EBX: size for enabled XCR0
+    fpusize = b;
+    cpuid(0xD, 1, &a, &b, &c, &d);
+    usexsaveopt = (a & XSAVEOPT) != 0;
+  } else
+    fpusize = FXSAVESIZE;
+  if(fpusize > PGSIZE)
+    panic("fpuinit");
+  lcr0((rcr0() & ~CR0_EM) | CR0_MP | CR0_NE | CR0_TS);
+}
+
+static void
+setts(int on)
+{
+  addr_t cr0;
+
+  cr0 = rcr0();
+  if(on && !(cr0 & CR0_TS))
+    lcr0(cr0 | CR0_TS);
+  else if(!on && (cr0 & CR0_TS))
+    clts();
+}
+
+// Are p's FPU registers loaded on this CPU?
+static int
+live(struct proc *p)
+{
+  return cpu->fpuowner == p && p->fpucpu == cpu->id;
+}
+
+static void
+save(char *area)
+{
+  if(usexsaveopt)
+    asm volatile("xsaveopt64 (%0)" : :
+                 "r" (area), "a" ((uint)xcr0), "d" ((uint)(xcr0 >> 32)) : "memory");
+  else if(usexsave)
+    asm volatile("xsave64 (%0)" : :
+                 "r" (area), "a" ((uint)xcr0), "d" ((uint)(xcr0 >> 32)) : "memory");
+  else
+    asm volatile("fxsave64 (%0)" : : "r" (area) : "memory");
+}
+
+static void
+restore(char *area)
+{
+  if(usexsave)
+    asm volatile("xrstor64 (%0)" : :
+                 "r" (area), "a" ((uint)xcr0), "d" ((uint)(xcr0 >> 32)) : "memory");
+  else
+    asm volatile("fxrstor64 (%0)" : : "r" (area) : "memory");
+}
+
+// Fill area with the state of a freshly initialized FPU.
+// A zero XSAVE header restores every component to its
+// initial state, except the x87 control word and MXCSR,
+// which are loaded from the legacy region.
+static void
+reset(char *area)
+{
+  memset(area, 0, fpusize);
+  *(ushort*)(area + 0) = 0x037F;   // FCW: all x87 exceptions masked
+  *(uint*)(area + 24) = 0x1F80;    // MXCSR: all SSE exceptions masked
+}
+
+// Decide whether p, about to run on this CPU, should find
+// its state in the registers or trap on first use.
+void
+fpuswitch(struct proc *p)
+{
+  setts(!live(p));
+}
+
+// p is being switched out.  Save its state if it is loaded.
+void
+fpuleave(struct proc *p)
+{
+  if(live(p))
+    save(p->fpu);
+}
+
+// Device-not-available trap: the current process used the
+// FPU with CR0.TS set.  Load its state, allocating a save
+// area on first use.  Return -1 if out of memory.
+int
+fputrap(void)
+{
+  if(proc->fpu == 0){
+    if((proc->fpu = kalloc()) == 0)
+      return -1;
+    reset(proc->fpu);
+  }
+  clts();
+  restore(proc->fpu);
+  cpu->fpuowner = proc;
+  proc->fpucpu = cpu->id;
+  return 0;
+}
+
+// Give np, a new child or thread, a copy of the current
+// process's FPU state.  Return -1 if out of memory.
+int
+fpufork(struct proc *np)
+{
+  if(proc->fpu == 0)
+    return 0;
+  if((np->fpu = kalloc()) == 0)
+    return -1;
+  pushcli();
+  if(live(proc))
+    save(proc->fpu);
+  popcli();
+  memmove(np->fpu, proc->fpu, fpusize);
+  return 0;
+}
+
+// exec: start the new image with a clean FPU.
+void
+fpuexec(void)
+{
+  pushcli();
+  if(live(proc)){
+    cpu->fpuowner = 0;
+    setts(1);
+  }
+  proc->fpucpu = -1;
+  popcli();
+  if(proc->fpu)
+    reset(proc->fpu);
+}
+
+// Release p's save area.
+void
+fpufree(struct proc *p)
+{
+  if(p->fpu)
+    kfree(p->fpu);
+  p->fpu = 0;
+  p->fpucpu = -1;
+}
@@ -14,8 +14,9 @@
 #include "param.h"
 #include "stat.h"
 #include "mmu.h"
-#include "proc.h"
 #include "spinlock.h"
+#include "rwlock.h"
+#include "proc.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
@@ -23,6 +24,7 @@
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 static void itrunc(struct inode*);
+static void ncinit(void);
 // there should be one superblock per disk device, but we run with
 // only one device
 struct superblock sb; 
@@ -155,9 +157,19 @@ bfree(int dev, uint b)
 // Many internal file system functions expect the caller to
 // have locked the inodes involved; this lets callers create
 // multi-step atomic operations.
+//
+// icache.lock guards the assignment of cache entries to inodes,
+// but iget() first looks for a cached inode without it.  Entries
+// are never freed, so that search need only take a reference
+// atomically, from a count that is not zero, and then check
+// that the entry still holds the inode it was after.  Hence
+// ip->ref changes only by atomic instructions.  Only iget()
+// writes icache.lock, to assign an entry; iput() reads it, which
+// is enough to keep iget() from seeing a count pass through
+// zero.
 
 struct {
-  struct spinlock lock;
+  struct rwlock lock;
   struct inode inode[NINODE];
 } icache;
 
@@ -166,7 +178,8 @@ iinit(int dev)
 {
   int i = 0;
   
-  initlock(&icache.lock, "icache");
+  initrwlock(&icache.lock, "icache");
+  ncinit();
   for(i = 0; i < NINODE; i++) {
     initsleeplock(&icache.inode[i].lock, "inode");
   }
@@ -231,15 +244,34 @@ static struct inode*
 iget(uint dev, uint inum)
 {
   struct inode *ip, *empty;
+  int ref;
+
+  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
+    if(ip->dev != dev || ip->inum != inum)
+      continue;
+    // No names lead to an unlinked inode, whose last iput()
+    // may be truncating it; leave any such race to the slow path.
+    if((ip->flags & I_VALID) && ip->nlink == 0)
+      break;
+    do {
+      ref = *(volatile int*)&ip->ref;
+    } while(ref > 0 && !__sync_bool_compare_and_swap(&ip->ref, ref, ref+1));
+    if(ref == 0)
+      continue;
+    if(ip->dev == dev && ip->inum == inum)
+      return ip;
+    // Recycled under us.
+    iput(ip);
+  }
 
-  acquire(&icache.lock);
+  acquirewrite(&icache.lock);
 
   // Is the inode already cached?
   empty = 0;
   for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
     if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
-      ip->ref++;
-      release(&icache.lock);
+      __sync_fetch_and_add(&ip->ref, 1);
+      releasewrite(&icache.lock);
       return ip;
     }
     if(empty == 0 && ip->ref == 0)    // Remember empty slot.
@@ -253,9 +285,11 @@ iget(uint dev, uint inum)
   ip = empty;
   ip->dev = dev;
   ip->inum = inum;
-  ip->ref = 1;
   ip->flags = 0;
-  release(&icache.lock);
+  // The lock-free search must see dev and inum before ref.
+  __sync_synchronize();
+  ip->ref = 1;
+  releasewrite(&icache.lock);
 
   return ip;
 }
@@ -265,9 +299,7 @@ iget(uint dev, uint inum)
 struct inode*
 idup(struct inode *ip)
 {
-  acquire(&icache.lock);
-  ip->ref++;
-  release(&icache.lock);
+  __sync_fetch_and_add(&ip->ref, 1);
   return ip;
 }
 
@@ -320,18 +352,18 @@ iunlock(struct inode *ip)
 void
 iput(struct inode *ip)
 {
-  acquire(&icache.lock);
+  acquireread(&icache.lock);
   if(ip->ref == 1 && (ip->flags & I_VALID) && ip->nlink == 0){
     // inode has no links and no other references: truncate and free.
-    release(&icache.lock);
+    releaseread(&icache.lock);
     itrunc(ip);
     ip->type = 0;
     iupdate(ip);
-    acquire(&icache.lock);
+    acquireread(&icache.lock);
     ip->flags = 0;
   }
-  ip->ref--;
-  release(&icache.lock);
+  __sync_fetch_and_sub(&ip->ref, 1);
+  releaseread(&icache.lock);
 }
 
 // Common idiom: unlock, then put.
@@ -348,7 +380,9 @@ iunlockput(struct inode *ip)
 // The content (data) associated with each inode is stored
 // in blocks on the disk. The first NDIRECT block numbers
 // are listed in ip->addrs[].  The next NINDIRECT blocks are
-// listed in block ip->addrs[NDIRECT].
+// listed in block ip->addrs[NDIRECT].  The last NDINDIRECT
+// are listed in the indirect blocks that block
+// ip->addrs[NDIRECT+1] lists.
 
 // Return the disk block address of the nth block in inode ip.
 // If there is no such block, bmap allocates one.
@@ -378,6 +412,29 @@ bmap(struct inode *ip, uint bn)
     brelse(bp);
     return addr;
   }
+  bn -= NINDIRECT;
+
+  if(bn < NDINDIRECT){
+    // Load the double-indirect block, then the indirect
+    // block it lists, allocating either if necessary.
+    if((addr = ip->addrs[NDIRECT+1]) == 0)
+      ip->addrs[NDIRECT+1] = addr = balloc(ip->dev);
+    bp = bread(ip->dev, addr);
+    a = (uint*)bp->data;
+    if((addr = a[bn / NINDIRECT]) == 0){
+      a[bn / NINDIRECT] = addr = balloc(ip->dev);
+      log_write(bp);
+    }
+    brelse(bp);
+    bp = bread(ip->dev, addr);
+    a = (uint*)bp->data;
+    if((addr = a[bn % NINDIRECT]) == 0){
+      a[bn % NINDIRECT] = addr = balloc(ip->dev);
+      log_write(bp);
+    }
+    brelse(bp);
+    return addr;
+  }
 
   panic("bmap: out of range");
 }
@@ -391,8 +448,8 @@ static void
 itrunc(struct inode *ip)
 {
   int i, j;
-  struct buf *bp;
-  uint *a;
+  struct buf *bp, *bp2;
+  uint *a, *a2;
 
   for(i = 0; i < NDIRECT; i++){
     if(ip->addrs[i]){
@@ -413,6 +470,26 @@ itrunc(struct inode *ip)
     ip->addrs[NDIRECT] = 0;
   }
 
+  if(ip->addrs[NDIRECT+1]){
+    bp = bread(ip->dev, ip->addrs[NDIRECT+1]);
+    a = (uint*)bp->data;
+    for(i = 0; i < NINDIRECT; i++){
+      if(!a[i])
+        continue;
+      bp2 = bread(ip->dev, a[i]);
+      a2 = (uint*)bp2->data;
+      for(j = 0; j < NINDIRECT; j++){
+        if(a2[j])
+          bfree(ip->dev, a2[j]);
+      }
+      brelse(bp2);
+      bfree(ip->dev, a[i]);
+    }
+    brelse(bp);
+    bfree(ip->dev, ip->addrs[NDIRECT+1]);
+    ip->addrs[NDIRECT+1] = 0;
+  }
+
   ip->size = 0;
   iupdate(ip);
 }
@@ -506,6 +583,171 @@ namecmp(const char *s, const char *t)
   return strncmp(s, t, DIRSIZ);
 }
 
+// Name cache.
+//
+// Remembers the inode numbers of names found by dirlookup(),
+// so that namex() can step through a directory without locking
+// it.  Readers walk the hash chains under rcureadlock();
+// ncache.lock guards changes.  An entry is filled in before it
+// is linked and never changes while linked.  One unlinked from
+// its chain stays on the free list until grace period freegp
+// has ended, since a reader may still be standing on it.
+//
+// Entries are added under the directory's sleeplock, as is
+// every change to a directory, and unlink calls ncremove()
+// before it drops that lock and its reference to the inode.
+// A lookup takes its reference inside the read-side section
+// and then checks that the entry is still linked; if so, the
+// reference came before the unlink, and the inode is the one
+// the name led to.
+// "." and ".." are not cached: a directory's ".." would
+// outlive the directory if its inode number were reused.
+
+#define NNCACHE 128
+#define NNCHASH 64
+
+struct ncent {
+  struct ncent *next;   // Hash chain
+  int inuse;            // On a chain
+  uint64 freegp;        // If not, reusable once this ends
+  uint dev;
+  uint dinum;           // Directory
+  uint inum;            // What name there refers to
+  char name[DIRSIZ];
+};
+
+static struct {
+  struct spinlock lock;
+  struct ncent *hash[NNCHASH];
+  struct ncent ent[NNCACHE];
+  int hand;             // Next entry to evict
+} ncache;
+
+static void
+ncinit(void)
+{
+  initlock(&ncache.lock, "ncache");
+}
+
+static struct ncent**
+nchash(uint dev, uint dinum, char *name)
+{
+  uint h;
+  int i;
+
+  h = dev*31 + dinum;
+  for(i = 0; i < DIRSIZ && name[i]; i++)
+    h = h*31 + (uchar)name[i];
+  return &ncache.hash[h % NNCHASH];
+}
+
+static int
+ncdot(char *name)
+{
+  return namecmp(name, ".") == 0 || namecmp(name, "..") == 0;
+}
+
+// Return the inode name refers to in directory dp, unlocked
+// and with a reference, or 0 if it is not cached.
+// Must be called inside a transaction since it calls iput().
+static struct inode*
+nclookup(struct inode *dp, char *name)
+{
+  struct ncent *e;
+  struct inode *ip, *stale;
+
+  ip = stale = 0;
+  rcureadlock();
+  for(e = *nchash(dp->dev, dp->inum, name); e; e = e->next){
+    if(e->dinum == dp->inum && e->dev == dp->dev &&
+       namecmp(e->name, name) == 0){
+      ip = iget(e->dev, e->inum);
+      __sync_synchronize();
+      if(!e->inuse){
+        // Unlinked since: the inode may be gone or reused.
+        stale = ip;
+        ip = 0;
+      }
+      break;
+    }
+  }
+  rcureadunlock();
+  if(stale)
+    iput(stale);
+  return ip;
+}
+
+// Unlink e from its chain.  Caller holds ncache.lock.
+static void
+ncunlink(struct ncent *e)
+{
+  struct ncent **pp;
+
+  for(pp = nchash(e->dev, e->dinum, e->name); *pp; pp = &(*pp)->next){
+    if(*pp == e){
+      *pp = e->next;
+      break;
+    }
+  }
+  e->inuse = 0;
+  e->freegp = rcustart();
+}
+
+// Note that name in directory dp refers to inode inum.
+// Caller holds dp's lock.  If no entry is free, evict one
+// for next time instead.
+static void
+ncinsert(struct inode *dp, char *name, uint inum)
+{
+  struct ncent *e, **h;
+
+  if(ncdot(name))
+    return;
+  acquire(&ncache.lock);
+  h = nchash(dp->dev, dp->inum, name);
+  for(e = *h; e; e = e->next)
+    if(e->dinum == dp->inum && e->dev == dp->dev && namecmp(e->name, name) == 0)
+      goto out;
+  for(e = ncache.ent; e < &ncache.ent[NNCACHE]; e++)
+    if(!e->inuse && rcudone(e->freegp))
+      break;
+  if(e == &ncache.ent[NNCACHE]){
+    e = &ncache.ent[ncache.hand];
+    ncache.hand = (ncache.hand + 1) % NNCACHE;
+    if(e->inuse)
+      ncunlink(e);
+    goto out;
+  }
+  e->dev = dp->dev;
+  e->dinum = dp->inum;
+  e->inum = inum;
+  strncpy(e->name, name, DIRSIZ);
+  e->inuse = 1;
+  e->next = *h;
+  // Readers that find e must see it filled in.
+  __sync_synchronize();
+  *h = e;
+out:
+  release(&ncache.lock);
+}
+
+// Forget name in directory dp, which is being removed.
+// Caller holds dp's lock.
+void
+ncremove(struct inode *dp, char *name)
+{
+  struct ncent *e;
+
+  acquire(&ncache.lock);
+  for(e = *nchash(dp->dev, dp->inum, name); e; e = e->next){
+    if(e->dinum == dp->inum && e->dev == dp->dev && namecmp(e->name, name) == 0){
+      ncunlink(e);
+      break;
+    }
+  }
+  release(&ncache.lock);
+}
+
 // Look for a directory entry in a directory.
 // If found, set *poff to byte offset of entry.
 struct inode*
@@ -527,6 +769,7 @@ dirlookup(struct inode *dp, char *name, uint *poff)
       if(poff)
         *poff = off;
       inum = de.inum;
+      ncinsert(dp, name, inum);
       return iget(dp->dev, inum);
     }
   }
@@ -616,9 +859,16 @@ namex(char *path, int nameiparent, char *name)
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
   else
-    ip = idup(proc->cwd);
+    ip = idup(proc->leader->cwd);
 
   while((path = skipelem(path, name)) != 0){
+    // Only a directory can have names cached in it.
+    if(!(nameiparent && *path == '\0') && !ncdot(name) &&
+       (next = nclookup(ip, name)) != 0){
+      iput(ip);
+      ip = next;
+      continue;
+    }
     ilock(ip);
     if(ip->type != T_DIR){
       iunlockput(ip);
@@ -0,0 +1,148 @@
+// Futexes: sleeping on a word of user memory.
+//
+// A user-level lock takes its fast path with an atomic
+// instruction and only calls futex() when it is contended:
+// FUTEX_WAIT sleeps as long as the word still holds the
+// expected value, FUTEX_WAKE wakes waiters after the lock
+// holder changes it.
+//
+// Waiters are keyed by the physical address of the word,
+// so threads, and any processes that map the same page,
+// find each other.  Each key hashes to one of NFUTEXHASH
+// buckets; a bucket holds a spinlock and a list of waiters
+// that live on the waiters' kernel stacks.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "futex.h"
+
+#define NFUTEXHASH 64
+
+struct futexwaiter {
+  addr_t key;                // Physical address of the futex word
+  int woken;                 // Set by futexwake()
+  struct futexwaiter *next;
+};
+
+struct futexbucket {
+  struct spinlock lock;
+  struct futexwaiter *head;
+};
+
+static struct futexbucket futextab[NFUTEXHASH];
+
+#define FUTEXBUCKET(key) (&futextab[((key)/sizeof(int)) % NFUTEXHASH])
+
+void
+futexinit(void)
+{
+  int i;
+
+  for(i = 0; i < NFUTEXHASH; i++)
+    initlock(&futextab[i].lock, "futex");
+}
+
+// Translate the user address of a futex word into its key.
+// Returns 0 if addr is not a valid, aligned word.
+static addr_t
+futexkey(addr_t addr)
+{
+  char *page;
+
+  if(addr % sizeof(int) != 0 || addr >= proc->sz || addr+sizeof(int) > proc->sz)
+    return 0;
+  if((page = uva2ka(proc->pgdir, (char*)PGROUNDDOWN(addr))) == 0)
+    return 0;
+  return V2P(page) + addr%PGSIZE;
+}
+
+static int
+futexwait(addr_t key, int val)
+{
+  struct futexbucket *b;
+  struct futexwaiter w, **pp;
+
+  b = FUTEXBUCKET(key);
+  acquire(&b->lock);
+
+  // A waker changes the word before calling FUTEX_WAKE, which
+  // takes the bucket lock, so checking the value under the
+  // lock cannot miss a wakeup.  Read it through the kernel's
+  // mapping of the physical page: another thread sharing the
+  // pgdir may have unmapped the user address since futexkey().
+  if(*(int*)P2V(key) != val){
+    release(&b->lock);
+    return -1;
+  }
+
+  w.key = key;
+  w.woken = 0;
+  w.next = b->head;
+  b->head = &w;
+
+  while(!w.woken){
+    if(proc->killed){
+      for(pp = &b->head; *pp; pp = &(*pp)->next){
+        if(*pp == &w){
+          *pp = w.next;
+          break;
+        }
+      }
+      release(&b->lock);
+      return -1;
+    }
+    sleep(&w, &b->lock);
+  }
+  release(&b->lock);
+  return 0;
+}
+
+static int
+futexwake(addr_t key, int n)
+{
+  struct futexbucket *b;
+  struct futexwaiter *w, **pp;
+  int woken;
+
+  b = FUTEXBUCKET(key);
+  acquire(&b->lock);
+  woken = 0;
+  pp = &b->head;
+  while(woken < n && (w = *pp) != 0){
+    if(w->key != key){
+      pp = &w->next;
+      continue;
+    }
+    *pp = w->next;
+    w->woken = 1;
+    wakeup(w);
+    woken++;
+  }
+  release(&b->lock);
+  return woken;
+}
+
+// FUTEX_WAIT: if *addr == val, sleep until a FUTEX_WAKE on addr.
+//   Returns 0 when woken, -1 if *addr != val or on error.
+// FUTEX_WAKE: wake at most val waiters on addr.
+//   Returns the number woken, or -1 on error.
+int
+futex(addr_t addr, int op, int val)
+{
+  addr_t key;
+
+  if((key = futexkey(addr)) == 0)
+    return -1;
+  switch(op){
+  case FUTEX_WAIT:
+    return futexwait(key, val);
+  case FUTEX_WAKE:
+    return futexwake(key, val);
+  }
+  return -1;
+}
@@ -5,13 +5,14 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "x86.h"
 #include "traps.h"
-#include "spinlock.h"
 #include "sleeplock.h"
 #include "fs.h"
 #include "buf.h"
+#include "workq.h"
 
 #define SECTOR_SIZE   512
 #define IDE_BSY       0x80
@@ -33,6 +34,11 @@ static struct buf *idequeue;
 
 static int havedisk1;
 static void idestart(struct buf*);
+static void idedone(void*);
+
+// The interrupt handler leaves copying in the data and
+// waking the waiter to a kernel thread.
+static struct work idework = { .fn = idedone };
 
 // Wait for IDE disk to become ready.
 static int
@@ -52,7 +58,7 @@ ideinit(void)
 {
   int i;
 
-  initlock(&idelock, "ide");
+  initlockkind(&idelock, "ide", LK_TICKET);
   ioapicenable(IRQ_IDE, ncpu - 1);
   idewait(0);
 
@@ -102,6 +108,13 @@ idestart(struct buf *b)
 // Interrupt handler.
 void
 ideintr(void)
+{
+  queuework(&idework);
+}
+
+// Finish the active request, in a kernel worker thread.
+static void
+idedone(void *arg)
 {
   struct buf *b;
 
@@ -8,6 +8,7 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "spinlock.h"
+#include "counter.h"
 
 void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file
@@ -30,7 +31,7 @@ struct {
 void
 kinit1(void *vstart, void *vend)
 {
-  initlock(&kmem.lock, "kmem");
+  initlockkind(&kmem.lock, "kmem", LK_MCS);
   kmem.use_lock = 0;
   freerange(vstart, vend);
 }
@@ -66,8 +67,11 @@ kfree(char *v)
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
 
-  if(kmem.use_lock)
+  // Until kinit2(), not every CPU has local storage to count in.
+  if(kmem.use_lock){
+    countinc(CNT_KFREE);
     acquire(&kmem.lock);
+  }
   r = (struct run*)v;
   r->next = kmem.freelist;
   kmem.freelist = r;
@@ -83,8 +87,10 @@ kalloc(void)
 {
   struct run *r;
 
-  if(kmem.use_lock)
+  if(kmem.use_lock){
+    countinc(CNT_KALLOC);
     acquire(&kmem.lock);
+  }
   r = kmem.freelist;
   if(r)
     kmem.freelist = r->next;
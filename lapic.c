@@ -9,6 +9,7 @@
 #include "traps.h"
 #include "mmu.h"
 #include "x86.h"
+#include "spinlock.h"
 #include "proc.h"  // ncpu
 
 // Local APIC registers, divided by 4 for use as uint[] indices.
@@ -43,6 +44,7 @@
 #define TDCR    (0x03E0/4)   // Timer Divide Configuration
 
 volatile uint *lapic;  // Initialized in mp.c
+static uint lapickhz;  // Timer counts per millisecond
 
 static void
 lapicw(int index, int value)
@@ -55,19 +57,30 @@ lapicw(int index, int value)
 void
 lapicinit(void)
 {
+  uint64 t0;
+
   if(!lapic)
     return;
 
   // Enable local APIC; set spurious interrupt vector.
   lapicw(SVR, ENABLE | (T_IRQ0 + IRQ_SPURIOUS));
 
-  // The timer repeatedly counts down at bus frequency
-  // from lapic[TICR] and then issues an interrupt.
-  // If xv6 cared more about precise timekeeping,
-  // TICR would be calibrated using an external time source.
+  // The timer counts down at bus frequency from lapic[TICR]
+  // and then issues an interrupt.  Measure that frequency
+  // against the TSC once (see clockinit), then run the timer
+  // in one-shot mode; clockintr re-arms it.  The first
+  // interrupt, in a millisecond, starts the scheduling tick.
   lapicw(TDCR, X1);
-  lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
-  lapicw(TICR, 10000000);
+  if(lapickhz == 0){
+    lapicw(TIMER, MASKED | (T_IRQ0 + IRQ_TIMER));
+    lapicw(TICR, 0xFFFFFFFF);
+    t0 = rdtsc();
+    while(rdtsc() - t0 < (uint64)tsckhz * 10)
+      ;
+    lapickhz = (0xFFFFFFFF - lapic[TCCR]) / 10;
+  }
+  lapicw(TIMER, T_IRQ0 + IRQ_TIMER);
+  lapicw(TICR, lapickhz);
 
   // Disable logical interrupt lines.
   lapicw(LINT0, MASKED);
@@ -134,6 +147,44 @@ lapiceoi(void)
     lapicw(EOI, 0);
 }
 
+// Send interrupt vector to the CPU with the given APIC ID.
+// Caller must have interrupts disabled, since an interrupt
+// handler sending its own IPI would clobber ICRHI/ICRLO.
+void
+lapicipi(uchar apicid, int vector)
+{
+  if(!lapic)
+    return;
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | ASSERT | vector);
+  while(lapic[ICRLO] & DELIVS)
+    ;
+}
+
+// Arrange a timer interrupt on this CPU in ns nanoseconds,
+// or cancel the pending one if ns is 0.  Long intervals
+// are cut short; clockintr just re-arms.
+void
+lapicarm(uint64 ns)
+{
+  uint64 count;
+
+  if(!lapic)
+    return;
+  if(ns == 0){
+    lapicw(TICR, 0);
+    return;
+  }
+  if(ns > 1000000000)
+    ns = 1000000000;
+  count = ns / 1000000 * lapickhz + ns % 1000000 * lapickhz / 1000000;
+  if(count == 0)
+    count = 1;
+  if(count > 0xFFFFFFFF)
+    count = 0xFFFFFFFF;
+  lapicw(TICR, count);
+}
+
 // Spin for a given number of microseconds.
 // On real hardware would want to tune this dynamically.
 void
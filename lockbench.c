@@ -0,0 +1,80 @@
+// lockbench [ms]
+// For each kind of kernel spinlock, for a reader-writer lock
+// taken mostly to read, and for per-CPU counters packed into
+// one cache line and padded apart, run the lock benchmark
+// for ms milliseconds (default 200) on 1 to ncpu CPUs at once,
+// one pinned process per CPU.  Print acquisitions per ms in
+// total and by the slowest and fastest CPU.
+
+#include "types.h"
+#include "stat.h"
+#include "param.h"
+#include "user.h"
+
+// LK_* in spinlock.h, then BENCH_* in bench.c.
+char *kinds[] = { "tas", "ticket", "mcs", "rwlock", "packed", "padded" };
+#define NKIND (sizeof(kinds)/sizeof(kinds[0]))
+
+int
+run(int kind, int ncpu, int ms, int *min, int *max)
+{
+  int i, n, total, go[2], res[2];
+  char c;
+
+  if(pipe(go) < 0 || pipe(res) < 0){
+    printf(2, "lockbench: pipe failed\n");
+    exit();
+  }
+  for(i = 0; i < ncpu; i++){
+    if(fork() == 0){
+      close(go[1]);
+      sched_setaffinity(0, 1 << i);
+      read(go[0], &c, 1);  // start together
+      n = lockbench(kind, ms);
+      write(res[1], &n, sizeof(n));
+      exit();
+    }
+  }
+  close(go[0]);
+  close(go[1]);
+  total = 0;
+  *min = -1;
+  *max = 0;
+  for(i = 0; i < ncpu; i++){
+    if(read(res[0], &n, sizeof(n)) != sizeof(n) || n < 0){
+      printf(2, "lockbench: run failed\n");
+      exit();
+    }
+    total += n;
+    if(*min < 0 || n < *min)
+      *min = n;
+    if(n > *max)
+      *max = n;
+  }
+  for(i = 0; i < ncpu; i++)
+    wait();
+  close(res[0]);
+  close(res[1]);
+  return total;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int kind, n, ncpu, ms, total, min, max;
+
+  ms = argc > 1 ? atoi(argv[1]) : 200;
+  if(ms <= 0)
+    ms = 200;
+  ncpu = schedstat(0, 0, 0);
+  if(ncpu > NCPU)
+    ncpu = NCPU;
+  for(kind = 0; kind < NKIND; kind++){
+    for(n = 1; n <= ncpu; n++){
+      total = run(kind, n, ms, &min, &max);
+      printf(1, "%s %d cpus: %d/ms, per cpu %d to %d/ms\n",
+             kinds[kind], n, total / ms, min / ms, max / ms);
+    }
+  }
+  exit();
+}
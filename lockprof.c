@@ -0,0 +1,212 @@
+// Spinlock profiling.
+//
+// Locks are grouped into classes by name, so that, say, all
+// the "proc" locks or all the "pipe" locks count together and
+// a lock in freed memory leaves nothing dangling.  initlock()
+// looks up or registers the class; acquire() and release()
+// report to lockacquired() and lockreleased(), which count
+// into per-CPU slots so that CPUs never share a counter.
+// Each slot also remembers the NCLASSSITE call sites that
+// spun the most on this CPU; lockstat() merges them.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "x86.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "lockstat.h"
+
+#define NLOCKCLASS 32
+#define NCLASSSITE 8
+
+// One CPU's counts for a class.
+struct classcpu {
+  uint64 nacquire;
+  uint64 ncontend;
+  uint64 spin;
+  uint64 hold;
+  uint64 maxhold;
+  struct {
+    addr_t pc;
+    uint64 ncontend;
+    uint64 spin;
+  } site[NCLASSSITE];
+} __attribute__((aligned(CACHELINE)));
+
+struct lockclass {
+  char *name;
+  struct classcpu cpu[NCPU];
+};
+
+static struct lockclass classes[NLOCKCLASS];
+static int nclass;
+// Guards registration.  Not a spinlock: initlock() runs before
+// there is a struct cpu, and a spinlock would need a class.
+static uint classlock;
+
+// Return the class for locks called name, registering it if
+// it is new.  Classes that do not fit share the last slot.
+struct lockclass*
+lockclass(char *name)
+{
+  struct lockclass *c;
+  addr_t rflags;
+  int i;
+
+  rflags = readeflags();
+  cli();
+  while(xchg(&classlock, 1) != 0)
+    pause();
+  for(i = 0; i < nclass; i++)
+    if(strncmp(classes[i].name, name, 16) == 0)
+      break;
+  if(i == nclass){
+    if(nclass < NLOCKCLASS-1)
+      classes[nclass++].name = name;
+    else {
+      i = NLOCKCLASS-1;
+      classes[i].name = "(other)";
+      nclass = NLOCKCLASS;
+    }
+  }
+  c = &classes[i];
+  __sync_synchronize();
+  classlock = 0;
+  if(rflags & FL_IF)
+    sti();
+  return c;
+}
+
+// lk was just acquired from pc, after spinning since start
+// (a TSC value) if start is non-zero.  Interrupts are off.
+void
+lockacquired(struct spinlock *lk, uint64 start, addr_t pc)
+{
+  uint64 now, spin;
+  int i, min;
+  struct classcpu *s;
+
+  now = rdtsc();
+  lk->acqat = now;
+  if(lk->class == 0)
+    return;
+  s = &lk->class->cpu[cpu->id];
+  s->nacquire++;
+  if(start == 0)
+    return;
+  spin = now - start;
+  s->ncontend++;
+  s->spin += spin;
+  min = 0;
+  for(i = 0; i < NCLASSSITE; i++){
+    if(s->site[i].pc == pc)
+      break;
+    if(s->site[i].spin < s->site[min].spin)
+      min = i;
+  }
+  if(i == NCLASSSITE){
+    // Evict the site that spun least.
+    i = min;
+    s->site[i].pc = pc;
+    s->site[i].ncontend = 0;
+    s->site[i].spin = 0;
+  }
+  s->site[i].ncontend++;
+  s->site[i].spin += spin;
+}
+
+// lk, held by this CPU, is about to be released.
+void
+lockreleased(struct spinlock *lk)
+{
+  uint64 hold;
+  struct classcpu *s;
+
+  if(lk->class == 0)
+    return;
+  hold = rdtsc() - lk->acqat;
+  s = &lk->class->cpu[cpu->id];
+  s->hold += hold;
+  if(hold > s->maxhold)
+    s->maxhold = hold;
+}
+
+// Sum the sites of class c that spun on pc.
+static void
+sitesum(struct lockclass *c, addr_t pc, uint64 *n, uint64 *spin)
+{
+  int i, j;
+
+  *n = *spin = 0;
+  for(i = 0; i < ncpu; i++)
+    for(j = 0; j < NCLASSSITE; j++)
+      if(c->cpu[i].site[j].pc == pc){
+        *n += c->cpu[i].site[j].ncontend;
+        *spin += c->cpu[i].site[j].spin;
+      }
+}
+
+// Fill st's call sites with the NLOCKSITE pcs that spun the
+// most on locks of class c, summed over all CPUs.
+static void
+topsites(struct lockclass *c, struct lockstat *st)
+{
+  int i, j, k, m;
+  addr_t pc;
+  uint64 n, spin;
+
+  for(k = 0; k < NLOCKSITE; k++){
+    for(i = 0; i < ncpu; i++){
+      for(j = 0; j < NCLASSSITE; j++){
+        if((pc = c->cpu[i].site[j].pc) == 0)
+          continue;
+        for(m = 0; m < k; m++)
+          if(st->site[m].pc == pc)
+            break;
+        if(m < k)
+          continue;
+        sitesum(c, pc, &n, &spin);
+        if(spin > st->site[k].spin || st->site[k].pc == 0){
+          st->site[k].pc = pc;
+          st->site[k].ncontend = n;
+          st->site[k].spin = spin;
+        }
+      }
+    }
+  }
+}
+
+// Copy the statistics of the first n lock classes to st, then
+// clear them all if reset is set.  Return the number of classes.
+// Unlocked: counts of locks in use meanwhile may be torn.
+int
+lockstat(struct lockstat *st, int n, int reset)
+{
+  struct lockclass *c;
+  int i, k, total;
+
+  total = nclass;
+  if(n > total)
+    n = total;
+  for(k = 0; k < n; k++, st++){
+    c = &classes[k];
+    memset(st, 0, sizeof(*st));
+    safestrcpy(st->name, c->name, sizeof(st->name));
+    for(i = 0; i < ncpu; i++){
+      st->nacquire += c->cpu[i].nacquire;
+      st->ncontend += c->cpu[i].ncontend;
+      st->spin += c->cpu[i].spin;
+      st->hold += c->cpu[i].hold;
+      if(c->cpu[i].maxhold > st->maxhold)
+        st->maxhold = c->cpu[i].maxhold;
+    }
+    topsites(c, st);
+  }
+  if(reset)
+    for(k = 0; k < total; k++)
+      memset(classes[k].cpu, 0, sizeof(classes[k].cpu));
+  return total;
+}
@@ -0,0 +1,92 @@
+// lockstat [cmd [arg...]]
+// Print spinlock statistics, most contended first.  With a
+// command, clear them, run the command, and print what it
+// accumulated.  Times are in TSC cycles.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "lockstat.h"
+
+#define NSTAT 64
+
+struct lockstat st[NSTAT];
+
+// printf takes 32-bit arguments, but kernel pcs and cycle
+// counts need all 64 bits.  Print x in base 10 or 16, padded
+// with zeros to at least width digits.
+void
+print64(uint64 x, int base, int width)
+{
+  char buf[21];
+  int i;
+
+  i = sizeof(buf) - 1;
+  buf[i] = 0;
+  do {
+    buf[--i] = "0123456789abcdef"[x % base];
+    x /= base;
+  } while(x != 0 || --width > 0);
+  printf(1, "%s", buf + i);
+}
+
+int
+main(int argc, char **argv)
+{
+  int i, j, n, pid;
+  struct lockstat t;
+
+  if(argc > 1){
+    lockstat(st, 0, 1);
+    pid = fork();
+    if(pid < 0){
+      printf(2, "lockstat: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      exec(argv[1], argv+1);
+      printf(2, "lockstat: exec %s failed\n", argv[1]);
+      exit();
+    }
+    wait();
+  }
+
+  n = lockstat(st, NSTAT, 0);
+  if(n > NSTAT)
+    n = NSTAT;
+  // Sort by cycles spent spinning.
+  for(i = 1; i < n; i++){
+    t = st[i];
+    for(j = i; j > 0 && st[j-1].spin < t.spin; j--)
+      st[j] = st[j-1];
+    st[j] = t;
+  }
+  printf(1, "name            acquire  contend  spin      avghold  maxhold\n");
+  for(i = 0; i < n; i++){
+    if(st[i].nacquire == 0)
+      continue;
+    printf(1, "%s", st[i].name);
+    for(j = strlen(st[i].name); j < 16; j++)
+      printf(1, " ");
+    print64(st[i].nacquire, 10, 1);
+    printf(1, " ");
+    print64(st[i].ncontend, 10, 1);
+    printf(1, " ");
+    print64(st[i].spin, 10, 1);
+    printf(1, " ");
+    print64(st[i].hold / st[i].nacquire, 10, 1);
+    printf(1, " ");
+    print64(st[i].maxhold, 10, 1);
+    printf(1, "\n");
+    for(j = 0; j < NLOCKSITE && st[i].site[j].pc; j++){
+      printf(1, "  at ");
+      print64(st[i].site[j].pc, 16, 16);
+      printf(1, ": contended ");
+      print64(st[i].site[j].ncontend, 10, 1);
+      printf(1, ", spun ");
+      print64(st[i].site[j].spin, 10, 1);
+      printf(1, "\n");
+    }
+  }
+  exit();
+}
@@ -0,0 +1,17 @@
+#define NLOCKSITE 4  // call sites reported per lock
+
+// Statistics for all spinlocks sharing a name, as returned by
+// lockstat().  Times are in TSC cycles.
+struct lockstat {
+  char name[16];
+  uint64 nacquire;             // Acquisitions
+  uint64 ncontend;             // Acquisitions that had to spin
+  uint64 spin;                 // Cycles spent spinning
+  uint64 hold;                 // Cycles held; divide by nacquire for average
+  uint64 maxhold;              // Longest hold
+  struct {
+    uint64 pc;                 // Caller of acquire(), 0 if unused
+    uint64 ncontend;
+    uint64 spin;
+  } site[NLOCKSITE];           // Call sites that spun the longest
+};
@@ -3,6 +3,7 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "x86.h"
 
@@ -18,9 +19,11 @@ int
 main(void)
 {
   uartearlyinit();
+  stringinit();    // fast string instructions
   kinit1(end, P2V(4*1024*1024)); // phys page allocator
   kvmalloc();      // kernel page table
   mpinit();        // detect other processors
+  clockinit();     // calibrate time stamp counter
   lapicinit();     // interrupt controller
   tvinit();        // trap vectors
   seginit();       // segment descriptors
@@ -29,6 +32,10 @@ main(void)
   consoleinit();   // console hardware
   uartinit();      // serial port
   pinit();         // process table
+  cginit();        // CPU groups
+  futexinit();     // futex wait queues
+  smpcallinit();   // cross-CPU call mailboxes
+  rcuinit();       // read-copy-update
 //  tvinit();        // trap vectors
   binit();         // buffer cache
   fileinit();      // file table
@@ -36,6 +43,7 @@ main(void)
   startothers();   // start other processors
   kinit2(P2V(4*1024*1024), P2V(PHYSTOP)); // must come after startothers()
   userinit();      // first user process
+  workqinit();     // kernel worker threads
   mpmain();        // finish this processor's setup
 }
 
@@ -56,6 +64,7 @@ mpmain(void)
   cprintf("cpu%d: starting\n", cpunum());
   idtinit();       // load idt register
   syscallinit();   // syscall set up
+  fpuinit();       // FPU and SSE state
   xchg(&cpu->started, 1); // tell startothers() we're up
   scheduler();     // start running processes
 }
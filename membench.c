@@ -0,0 +1,44 @@
+// membench [ms]
+// Time the kernel's memmove, memset and memcmp against the
+// byte-at-a-time loops they replaced, on buffers of a few
+// sizes, for ms milliseconds (default 100) each.  Print the
+// throughput of each in MB/s.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+// MB_* in bench.c: the old way of each routine, then the new.
+char *names[] = { "memmove", "memset", "memcmp" };
+int sizes[] = { 16, 64, 512, 4096 };
+
+int
+rate(int kind, int n, int ms)
+{
+  int i;
+
+  if((i = membench(kind, n, ms)) < 0){
+    printf(2, "membench: kernel check failed\n");
+    exit();
+  }
+  return i / ms * n / 1000;
+}
+
+int
+main(int argc, char *argv[])
+{
+  int op, s, ms, old, new;
+
+  ms = argc > 1 ? atoi(argv[1]) : 100;
+  if(ms <= 0)
+    ms = 100;
+  for(op = 0; op < 3; op++){
+    for(s = 0; s < sizeof(sizes)/sizeof(sizes[0]); s++){
+      old = rate(2*op, sizes[s], ms);
+      new = rate(2*op + 1, sizes[s], ms);
+      printf(1, "%s %d bytes: old %d MB/s, new %d MB/s\n",
+             names[op], sizes[s], old, new);
+    }
+  }
+  exit();
+}
@@ -41,6 +41,7 @@
 #define CR4_PAE         0x00000020      // Physical address extensions
 #define CR4_OSXFSR      0x00000200      // OS supports FXSAVE and FXRSTOR
 #define CR4_OSXMMEXCPT  0x00000400      // OS supports SSE exceptions
+#define CR4_OSXSAVE     0x00040000      // OS supports XSAVE and XCR0
 
 // Model specific registers
 #define MSR_EFER	0xC0000080	// extended feature enable register
@@ -48,6 +49,8 @@
 #define MSR_LSTAR	0xC0000082	// stores syscall's entry rip 
 #define MSR_CSTAR	0xC0000083	// for compatiblity mode (not used)
 #define MSR_SFMASK	0xC0000084	// syscall flag mask
+#define MSR_FS_BASE	0xC0000100	// FS segment base (kernel per-cpu storage)
+#define MSR_GS_BASE	0xC0000101	// GS segment base (user thread-local storage)
 
 // various segment selectors.
 #define SEG_KCODE 1  // kernel code
@@ -9,6 +9,7 @@
 #include "mp.h"
 #include "x86.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 
 struct cpu cpus[NCPU];
@@ -87,6 +88,32 @@ mpconfig(struct mp **pmp)
   return conf;
 }
 
+// Number the last-level cache domains.  CPUs share a cache
+// when their APIC IDs differ only in the low bits that CPUID
+// leaf 4 says tell its sharers apart.  Without leaf 4, which
+// is Intel's, assume that no two CPUs share a cache.
+static void
+mpcache(void)
+{
+  uint a, b, c, d, i, n, level, shift, maxleaf;
+
+  level = shift = 0;
+  cpuid(0, 0, &maxleaf, &b, &c, &d);
+  for(i = 0; maxleaf >= 4; i++){
+    cpuid(4, i, &a, &b, &c, &d);
+    if((a & 0x1F) == 0)  // no more caches
+      break;
+    if(((a >> 5) & 7) >= level){
+      level = (a >> 5) & 7;
+      n = ((a >> 14) & 0xFFF) + 1;
+      for(shift = 0; (1 << shift) < n; shift++)
+        ;
+    }
+  }
+  for(i = 0; i < ncpu; i++)
+    cpus[i].llc = cpus[i].apicid >> shift;
+}
+
 void
 mpinit(void)
 {
@@ -106,6 +133,7 @@ mpinit(void)
     case MPPROC:
       proc = (struct mpproc*)p;
       if(ncpu < NCPU) {
+        cpus[ncpu].id = ncpu;
         cpus[ncpu].apicid = proc->apicid;  // apicid may differ from ncpu
         ncpu++;
       }
@@ -127,6 +155,7 @@ mpinit(void)
     }
   }
   cprintf("Seems we are SMP, ncpu = %d\n",ncpu);
+  mpcache();
   if(mp->imcrp){
     // Bochs doesn't support IMCR, so this doesn't run on Bochs.
     // But it would on real hardware.
@@ -0,0 +1,52 @@
+// pingpong [rounds]
+// Bounce a byte between two processes over a pair of pipes
+// and report the average round trip, which costs two context
+// switches each way on a single CPU.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "clock.h"
+
+int
+main(int argc, char **argv)
+{
+  int i, n, pid, p1[2], p2[2];
+  struct timespec t0, t1;
+  long ns;
+  char c;
+
+  n = argc > 1 ? atoi(argv[1]) : 10000;
+  if(n <= 0 || pipe(p1) < 0 || pipe(p2) < 0){
+    printf(2, "usage: pingpong [rounds]\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(2, "pingpong: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    for(i = 0; i < n; i++){
+      if(read(p1[0], &c, 1) != 1)
+        break;
+      write(p2[1], &c, 1);
+    }
+    exit();
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for(i = 0; i < n; i++){
+    write(p1[1], "x", 1);
+    if(read(p2[0], &c, 1) != 1){
+      printf(2, "pingpong: read failed\n");
+      break;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  wait();
+
+  ns = (t1.tv_sec - t0.tv_sec) * 1000000000 + (t1.tv_nsec - t0.tv_nsec);
+  printf(1, "%d round trips, %d ns each\n", i, (int)(ns / (i ? i : 1)));
+  exit();
+}
@@ -4,28 +4,125 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "x86.h"
-#include "proc.h"
+#include "traps.h"
 #include "spinlock.h"
+#include "sleeplock.h"
+#include "proc.h"
+#include "wait.h"
+#include "schedstat.h"
+#include "counter.h"
 
 struct {
-  struct spinlock lock;
   struct proc proc[NPROC];
 } ptable;
 
+// syscall_entry in entry.S loads proc->kstack from here.
+_Static_assert(__builtin_offsetof(struct proc, kstack) == 0x10, "proc kstack");
+
+// Guards the parent, children and sibling links, the thread
+// lists and nthreads, and so the sleeps in wait() and join().
+// Must be acquired before any p->lock.
+static struct spinlock waitlock;
+
+// Serializes changes to a thread group's address space:
+// growproc(), and fork() copying it.  One per leader's slot.
+// A sleeplock, since allocating or freeing a large region
+// takes a while and should not keep interrupts off.
+static struct sleeplock vmlocks[NPROC];
+#define VMLOCK(p) (&vmlocks[(p)->leader - ptable.proc])
+
 static struct proc *initproc;
 
+// Processes by pid, chained through pidnext.  Lookups walk
+// the chains under rcureadlock(); pidlock guards changes.
+#define NPIDHASH 64
+static struct proc *pidhash[NPIDHASH];
+static struct spinlock pidlock;
+
+// Per-CPU scheduler statistics, each written only by its
+// own CPU with interrupts off, on cache lines of its own.
+static struct {
+  struct schedstat s;
+} __attribute__((aligned(CACHELINE))) schedstats[NCPU];
+
 int nextpid = 1;
 extern void forkret(void);
 extern void syscall_trapret(void);
 
-static void wakeup1(void *chan);
+static void freeproc(struct proc *p);
+static void kthreadstart(void);
+static void switchdone(void);
+static void kick(struct proc *p);
+static void ready(struct proc *p);
 
 //#define NPROC 64
 
 void
 pinit(void)
 {
-  initlock(&ptable.lock, "ptable");
+  struct proc *p;
+
+  initlock(&waitlock, "wait");
+  initlock(&pidlock, "pid");
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    initlock(&p->lock, "proc");
+    initsleeplock(VMLOCK(p), "vm");
+  }
+}
+
+// Add p to the pid hash.
+static void
+pidinsert(struct proc *p)
+{
+  struct proc **h;
+
+  h = &pidhash[p->pid % NPIDHASH];
+  acquire(&pidlock);
+  p->pidnext = *h;
+  // Readers that find p must see it filled in.
+  __sync_synchronize();
+  *h = p;
+  release(&pidlock);
+}
+
+// Take p off the pid hash.  p->pidnext is left alone for
+// readers standing on p, which therefore must not be reused
+// until a grace period has passed.
+static void
+pidremove(struct proc *p)
+{
+  struct proc **pp;
+
+  acquire(&pidlock);
+  for(pp = &pidhash[p->pid % NPIDHASH]; *pp; pp = &(*pp)->pidnext){
+    if(*pp == p){
+      *pp = p->pidnext;
+      break;
+    }
+  }
+  release(&pidlock);
+}
+
+// Return the process with the given pid, locked,
+// or 0 if there is none.
+static struct proc*
+findproc(int pid)
+{
+  struct proc *p;
+
+  rcureadlock();
+  for(p = pidhash[pid % NPIDHASH]; p; p = p->pidnext){
+    if(p->pid != pid)
+      continue;
+    acquire(&p->lock);
+    if(p->pid == pid && p->state != UNUSED){
+      rcureadunlock();
+      return p;
+    }
+    release(&p->lock);
+  }
+  rcureadunlock();
+  return 0;
 }
 
 //PAGEBREAK: 32
@@ -38,27 +135,46 @@ allocproc(void)
 {
   struct proc *p;
   char *sp;
+  int pending;
 
-  acquire(&ptable.lock);
-
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == UNUSED)
-      goto found;
-
-  release(&ptable.lock);
-  return 0;
+  for(;;){
+    pending = 0;
+    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+      acquire(&p->lock);
+      if(p->state == UNUSED){
+        if(rcudone(p->freegp))
+          goto found;
+        pending = 1;
+      }
+      release(&p->lock);
+    }
+    if(!pending)
+      return 0;
+    // The only free slots were freed too recently.
+    rcusync();
+  }
 
 found:
   p->state = EMBRYO;
-  p->pid = nextpid++;
+  p->pid = __sync_fetch_and_add(&nextpid, 1);
+  p->leader = p;
+  p->nthreads = 1;
+  p->cpumask = (1 << ncpu) - 1;
+  p->fpucpu = -1;
+  p->wakecpu = -1;
+  p->wakefrom = -1;
 
-  release(&ptable.lock);
+  release(&p->lock);
 
   // Allocate kernel stack.
   if((p->kstack = kalloc()) == 0){
+    acquire(&p->lock);
+    p->leader = 0;
     p->state = UNUSED;
+    release(&p->lock);
     return 0;
   }
+  pidinsert(p);
   sp = p->kstack + KSTACKSIZE;
 
   // Leave room for trap frame.
@@ -89,6 +205,7 @@ userinit(void)
   p = allocproc();
   
   initproc = p;
+  cgfork(p);
   if((p->pgdir = setupkvm()) == 0)
     panic("userinit: out of memory?");
 
@@ -111,34 +228,116 @@ userinit(void)
   // run this process. the acquire forces the above
   // writes to be visible, and the lock is also needed
   // because the assignment might not be atomic.
-  acquire(&ptable.lock);
+  acquire(&p->lock);
 
-  p->state = RUNNABLE;
+  ready(p);
+  kick(p);
 
-  release(&ptable.lock);
+  release(&p->lock);
+}
+
+// Reload CR3 if this CPU is running in pgdir, flushing its TLB.
+static void
+flushtlb(void *pgdir)
+{
+  if(cpu->pgdir == pgdir)
+    lcr3(V2P(pgdir));
 }
 
 // Grow current process's memory by n bytes.
 // Return 0 on success, -1 on failure.
+// Holds the group's vm lock so that threads sharing the
+// address space cannot change it concurrently, and waitlock
+// briefly so that all of them see the new size.  Shrinking
+// unmaps the pages and flushes the TLB of every CPU that has
+// this address space loaded before the pages are freed, so a
+// sibling thread cannot touch them after they are reused.
 int
 growproc(int n)
 {
-  uint sz;
+  addr_t sz, newsz;
+  struct proc *p;
+  int i;
 
-  sz = proc->sz;
+  acquiresleep(VMLOCK(proc));
+  sz = newsz = proc->sz;
   if(n > 0){
-    if((sz = allocuvm(proc->pgdir, sz, sz + n)) == 0)
+    if((newsz = allocuvm(proc->pgdir, sz, sz + n)) == 0){
+      releasesleep(VMLOCK(proc));
       return -1;
+    }
   } else if(n < 0){
-    if((sz = deallocuvm(proc->pgdir, sz, sz + n)) == 0)
+    newsz = sz + n;
+    if(newsz > sz){
+      releasesleep(VMLOCK(proc));
       return -1;
+    }
+    unmapuvm(proc->pgdir, sz, newsz);
+    switchuvm(proc);
+    // A CPU that loads the page table after this point
+    // cannot cache the unmapped entries.
+    __sync_synchronize();
+    for(i = 0; i < ncpu; i++)
+      if(&cpus[i] != cpu && cpus[i].pgdir == proc->pgdir)
+        smpcall(i, flushtlb, proc->pgdir);
+    freeuvm(proc->pgdir, sz, newsz);
   }
-  proc->sz = sz;
-  switchuvm(proc);
+  acquire(&waitlock);
+  for(p = proc->leader; p; p = p->nextthread)
+    p->sz = newsz;
+  release(&waitlock);
+  releasesleep(VMLOCK(proc));
   return 0;
 }
 
 //PAGEBREAK!
+// Start a kernel thread, named name, that runs fn(arg) on the
+// CPUs in cpumask.  It has no user memory, open files or current
+// directory and is nobody's child; fn must not return.  Returns
+// the thread, or 0 if out of memory.
+struct proc*
+kthread(char *name, void (*fn)(void*), void *arg, uint cpumask)
+{
+  struct proc *p;
+
+  if((p = allocproc()) == 0)
+    return 0;
+  if((p->pgdir = setupkvm()) == 0){
+    acquire(&p->lock);
+    freeproc(p);
+    release(&p->lock);
+    return 0;
+  }
+  cgfork(p);
+  cpumask &= (1 << ncpu) - 1;
+  if(cpumask)
+    p->cpumask = cpumask;
+  // A kernel thread never uses its trap frame, so keep fn
+  // and arg there for kthreadstart().
+  p->tf->rip = (addr_t)fn;
+  p->tf->rdi = (addr_t)arg;
+  p->context->eip = (addr_t)kthreadstart;
+  safestrcpy(p->name, name, sizeof(p->name));
+
+  acquire(&p->lock);
+  ready(p);
+  kick(p);
+  release(&p->lock);
+  return p;
+}
+
+// A kernel thread's first scheduling switches here.
+static void
+kthreadstart(void)
+{
+  // Still holding our own lock, as in forkret().
+  switchdone();
+  release(&proc->lock);
+  sti();
+  ((void (*)(void*))proc->tf->rip)((void*)proc->tf->rdi);
+  panic("kthread returned");
+}
+
 // Create a new process copying p as the parent.
 // Sets up stack to return as if from system call.
 // Caller must set state of returned proc to RUNNABLE.
@@ -153,171 +352,689 @@ fork(void)
     return -1;
   }
 
-  // Copy process state from p.
-  if((np->pgdir = copyuvm(proc->pgdir, proc->sz)) == 0){
-    kfree(np->kstack);
-    np->kstack = 0;
-    np->state = UNUSED;
+  // Copy process state from p, which another thread may be
+  // growing or shrinking.
+  acquiresleep(VMLOCK(proc));
+  np->pgdir = copyuvm(proc->pgdir, proc->sz);
+  np->sz = proc->sz;
+  releasesleep(VMLOCK(proc));
+  if(np->pgdir == 0){
+    acquire(&np->lock);
+    freeproc(np);
+    release(&np->lock);
     return -1;
   }
-  np->sz = proc->sz;
-  np->parent = proc;
+  if(fpufork(np) < 0){
+    freevm(np->pgdir);
+    acquire(&np->lock);
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
+  np->parent = proc->leader;
+  np->tls = proc->tls;
+  np->cpumask = proc->cpumask;
+  cgfork(np);
   *np->tf = *proc->tf;
 
   // Clear %rax so that fork returns 0 in the child.
   np->tf->rax = 0;
 
+  // A sibling thread may be closing descriptors meanwhile.
   for(i = 0; i < NOFILE; i++)
-    if(proc->ofile[i])
-      np->ofile[i] = filedup(proc->ofile[i]);
-  np->cwd = idup(proc->cwd);
+    np->ofile[i] = fileget(&proc->leader->ofile[i]);
+  np->cwd = idup(proc->leader->cwd);
 
   safestrcpy(np->name, proc->name, sizeof(proc->name));
 
   pid = np->pid;
 
-  acquire(&ptable.lock);
+  acquire(&waitlock);
+  np->sibling = np->parent->children;
+  np->parent->children = np;
+  release(&waitlock);
+
+  acquire(&np->lock);
+  ready(np);
+  kick(np);
+  release(&np->lock);
+
+  return pid;
+}
+
+// Create a new thread in the current thread group.  It shares
+// the address space, open files and current directory, and
+// starts running fn(arg) on the user stack whose top is stack,
+// with tls loaded as its GS base.  If fn returns, the thread
+// faults on the fake return PC; it should call exit() instead.
+// Returns the new thread's pid, or -1 on failure.
+int
+clone(addr_t fn, addr_t arg, addr_t stack, addr_t tls)
+{
+  int pid;
+  addr_t sp, retpc;
+  struct proc *np;
+
+  sp = (stack & ~(addr_t)15) - sizeof(addr_t);
+  if(stack > proc->sz || sp >= stack)
+    return -1;
+  retpc = 0xffffffff;  // fake return PC
+  if(copyout(proc->pgdir, sp, &retpc, sizeof(retpc)) < 0)
+    return -1;
 
-  np->state = RUNNABLE;
+  if((np = allocproc()) == 0)
+    return -1;
+  if(fpufork(np) < 0){
+    acquire(&np->lock);
+    freeproc(np);
+    release(&np->lock);
+    return -1;
+  }
 
-  release(&ptable.lock);
+  np->pgdir = proc->pgdir;
+  np->leader = proc->leader;
+  np->parent = proc->leader;
+  np->ustack = stack;
+  np->tls = tls;
+  np->cpumask = proc->cpumask;
+  cgfork(np);
+  *np->tf = *proc->tf;
+
+  // Return to user space at fn(arg) on the new stack.
+  // sysret takes the user %rip from %rcx.
+  np->tf->rax = 0;
+  np->tf->rdi = arg;
+  np->tf->rip = fn;
+  np->tf->rcx = fn;
+  np->tf->rsp = sp;
+
+  safestrcpy(np->name, proc->name, sizeof(proc->name));
+
+  pid = np->pid;
+
+  acquire(&waitlock);
+  np->sz = np->leader->sz;  // growproc() updates it from here on
+  np->nextthread = np->leader->nextthread;
+  np->leader->nextthread = np;
+  np->leader->nthreads++;
+  release(&waitlock);
+
+  acquire(&np->lock);
+  ready(np);
+  kick(np);
+  release(&np->lock);
 
   return pid;
 }
 
+// Return a ZOMBIE or EMBRYO proc to the UNUSED pool.
+// Does not free the address space, which may be shared.
+// Caller must hold p->lock, even for an EMBRYO: its pid is
+// already in the hash, where findproc() may lock it.
+static void
+freeproc(struct proc *p)
+{
+  pidremove(p);
+  p->freegp = rcustart();
+  kfree(p->kstack);
+  p->kstack = 0;
+  fpufree(p);
+  cgfree(p);
+  p->pgdir = 0;
+  p->pid = 0;
+  p->parent = 0;
+  p->children = 0;
+  p->sibling = 0;
+  p->leader = 0;
+  p->nextthread = 0;
+  p->nthreads = 0;
+  p->ustack = 0;
+  p->tls = 0;
+  p->cpumask = 0;
+  p->name[0] = 0;
+  p->killed = 0;
+  p->state = UNUSED;
+}
+
+// Has every thread in leader's group exited?
+// Caller must hold waitlock, under which threads become ZOMBIE.
+static int
+groupdead(struct proc *leader)
+{
+  struct proc *p;
+
+  for(p = leader; p; p = p->nextthread)
+    if(p->state != ZOMBIE)
+      return 0;
+  return 1;
+}
+
+// Mark every thread in leader's group killed, waking the
+// ones that are asleep.  Caller must hold waitlock.
+static void
+killgroup(struct proc *leader)
+{
+  struct proc *p;
+
+  for(p = leader; p; p = p->nextthread){
+    acquire(&p->lock);
+    p->killed = 1;
+    if(p->state == SLEEPING){
+      ready(p);
+      kick(p);
+    }
+    release(&p->lock);
+  }
+}
+
 //PAGEBREAK!
-// Exit the current process.  Does not return.
-// An exited process remains in the zombie state
-// until its parent calls wait() to find out it exited.
+// Exit the current thread.  Does not return.
+// An exited thread remains in the zombie state
+// until another thread in its group calls join(), or
+// until the whole group has exited and the parent
+// of the group calls wait() to find out it exited.
 void
 exit(void)
 {
-  struct proc *p;
-  int fd;
+  struct proc *p, *leader;
+  int fd, last;
 
   if(proc == initproc)
     panic("init exiting");
 
-  // Close all open files.
-  for(fd = 0; fd < NOFILE; fd++){
-    if(proc->ofile[fd]){
-      fileclose(proc->ofile[fd]);
-      proc->ofile[fd] = 0;
+  leader = proc->leader;
+  acquire(&waitlock);
+  // The leader exiting, or any thread being killed,
+  // takes the rest of the group down with it.
+  if(proc == leader || proc->killed)
+    killgroup(leader);
+  last = --leader->nthreads == 0;
+  release(&waitlock);
+
+  // The last thread out closes the group's open files.
+  if(last){
+    for(fd = 0; fd < NOFILE; fd++){
+      if(leader->ofile[fd]){
+        fileclose(leader->ofile[fd]);
+        leader->ofile[fd] = 0;
+      }
     }
-  }
-
-  begin_op();
-  iput(proc->cwd);
-  end_op();
-  proc->cwd = 0;
 
-  acquire(&ptable.lock);
-
-  // Parent might be sleeping in wait().
-  wakeup1(proc->parent);
+    begin_op();
+    iput(leader->cwd);
+    end_op();
+    leader->cwd = 0;
+  }
 
-  // Pass abandoned children to init.
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->parent == proc){
-      p->parent = initproc;
-      if(p->state == ZOMBIE)
-        wakeup1(initproc);
+  acquire(&waitlock);
+
+  if(last){
+    // Parent might be sleeping in wait().
+    wakeup(leader->parent);
+
+    // Pass abandoned children to init.
+    if((p = leader->children) != 0){
+      for(;;){
+        p->parent = initproc;
+        if(p->state == ZOMBIE)
+          wakeup(initproc);
+        if(p->sibling == 0)
+          break;
+        p = p->sibling;
+      }
+      p->sibling = initproc->children;
+      initproc->children = leader->children;
+      leader->children = 0;
     }
+  } else {
+    // Another thread might be sleeping in join().
+    wakeup(leader);
   }
 
-  // Jump into the scheduler, never to return.
+  // Jump into the scheduler, never to return.  Our lock
+  // stays held until we are off this kernel stack, which
+  // keeps wait() and join() from freeing it under us.
+  acquire(&proc->lock);
   proc->state = ZOMBIE;
+  release(&waitlock);
   sched();
   panic("zombie exit");
 }
 
 //PAGEBREAK!
 // Wait for a child process to exit and return its pid.
-// Return -1 if this process has no children.
+// If pid > 0, wait only for the child with that pid.
+// With WNOHANG in options, return 0 instead of sleeping
+// if the child has not exited yet.
+// Return -1 if there is no such child.
 int
-wait(void)
+waitpid(int pid, int options)
 {
-  struct proc *p;
-  int havekids, pid;
+  struct proc *p, *q, **pp;
+  int havekids, cpid;
+  pde_t *pgdir;
 
-  acquire(&ptable.lock);
+  acquire(&waitlock);
   for(;;){
-    // Scan through table looking for exited children.
+    // Scan through our children looking for exited ones.
     havekids = 0;
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent != proc)
+    for(pp = &proc->leader->children; (p = *pp) != 0; pp = &p->sibling){
+      if(pid > 0 && p->pid != pid)
         continue;
       havekids = 1;
+      if(p->state == ZOMBIE && groupdead(p)){
+        // Found one.  Free threads that were never joined.
+        // Taking each thread's lock waits for it to finish
+        // switching away, after which pgdir is not in use.
+        cpid = p->pid;
+        pgdir = p->pgdir;
+        *pp = p->sibling;
+        while((q = p->nextthread) != 0){
+          p->nextthread = q->nextthread;
+          acquire(&q->lock);
+          freeproc(q);
+          release(&q->lock);
+        }
+        acquire(&p->lock);
+        freeproc(p);
+        release(&p->lock);
+        freevm(pgdir);
+        release(&waitlock);
+        return cpid;
+      }
+    }
+
+    // No point waiting if we don't have any children.
+    if(!havekids || proc->killed){
+      release(&waitlock);
+      return -1;
+    }
+    if(options & WNOHANG){
+      release(&waitlock);
+      return 0;
+    }
+
+    // Wait for children to exit.  (See wakeup call in exit.)
+    sleep(proc->leader, &waitlock);  //DOC: wait-sleep
+  }
+}
+
+// Wait for any child process to exit and return its pid.
+// Return -1 if this process has no children.
+int
+wait(void)
+{
+  return waitpid(-1, 0);
+}
+
+// Wait for another thread in this thread group to exit and
+// return its pid.  If ustack is non-zero, store the stack that
+// was passed to clone() there so the caller can free it.
+// Return -1 if there are no other threads to join.
+// The group leader cannot be joined.
+int
+join(addr_t *ustack)
+{
+  struct proc *p, **pp;
+  int havethreads, pid;
+
+  acquire(&waitlock);
+  for(;;){
+    havethreads = 0;
+    for(pp = &proc->leader->nextthread; (p = *pp) != 0; pp = &p->nextthread){
+      if(p == proc)
+        continue;
+      havethreads = 1;
       if(p->state == ZOMBIE){
-        // Found one.
         pid = p->pid;
-        kfree(p->kstack);
-        p->kstack = 0;
-        freevm(p->pgdir);
-        p->pid = 0;
-        p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
-        p->state = UNUSED;
-        release(&ptable.lock);
+        if(ustack)
+          *ustack = p->ustack;
+        *pp = p->nextthread;
+        acquire(&p->lock);
+        freeproc(p);
+        release(&p->lock);
+        release(&waitlock);
         return pid;
       }
     }
 
-    // No point waiting if we don't have any children.
-    if(!havekids || proc->killed){
-      release(&ptable.lock);
+    if(!havethreads || proc->killed){
+      release(&waitlock);
       return -1;
     }
 
-    // Wait for children to exit.  (See wakeup1 call in proc_exit.)
-    sleep(proc, &ptable.lock);  //DOC: wait-sleep
+    // Wait for a thread to exit.  (See wakeup call in exit.)
+    sleep(proc->leader, &waitlock);
   }
 }
 
 //PAGEBREAK: 42
+// Mark p RUNNABLE, noting when for the wakeup latency
+// histogram.  Caller must hold p->lock.
+static void
+ready(struct proc *p)
+{
+  p->state = RUNNABLE;
+  p->readyat = nsec();
+}
+
+// Count a time of ns nanoseconds in log2 histogram h.
+static void
+histadd(uint64 *h, uint64 ns)
+{
+  int b;
+
+  for(b = 0; ns > 1 && b < NSCHEDHIST-1; ns >>= 1)
+    b++;
+  h[b]++;
+}
+
+// p, just woken by the current process, is RUNNABLE.  If the
+// waker is about to sleep (sync), this CPU may run p and has
+// no other woken process waiting for it, leave p for it: p will
+// find what it was woken for in this CPU's cache.  Otherwise
+// prefer an idle CPU that shares this CPU's last-level cache.
+// A waker that keeps running must not hold p back, since
+// other CPUs pass over a process left for this one.
+// Wakeups from interrupts say nothing about who p talks to.
+// Caller must hold p->lock.
+static void
+place(struct proc *p, int sync)
+{
+  struct cpu *c;
+
+  if(proc == 0 || cpu->inintr)
+    return;
+  p->wakefrom = cpu->id;
+  c = 0;
+  if(sync && (p->cpumask & (1 << cpu->id)) && cpu->nwake == 0)
+    c = cpu;
+  else {
+    for(c = cpus; c < cpus+ncpu; c++)
+      if(c != cpu && c->idle && c->llc == cpu->llc && (p->cpumask & (1 << c->id)))
+        break;
+    if(c == cpus+ncpu)
+      return;
+  }
+  p->wakecpu = c->id;
+  __sync_fetch_and_add(&c->nwake, 1);
+}
+
+// Send a reschedule IPI to one idle CPU that may run p, which
+// just became RUNNABLE.  A CPU that is already awake will find
+// p on its next scan of ptable.  If p may only run on CPUs
+// other than this one and they are all busy, preempt one of
+// them rather than leave p waiting for its next tick.
+// Caller must hold p->lock.
+static void
+kick(struct proc *p)
+{
+  struct cpu *c;
+
+  // Order the store making p RUNNABLE before the loads of
+  // the idle flags; scheduler() does the reverse.
+  __sync_synchronize();
+
+  // Left for a CPU by place(): wake it if it is idle.
+  if(p->wakecpu >= 0){
+    c = &cpus[p->wakecpu];
+    if(c != cpu && c->idle){
+      c->idle = 0;
+      lapicipi(c->apicid, T_IRQ0 + IRQ_RESCHED);
+    }
+    return;
+  }
+
+  // An idle CPU taking an interrupt rescans when the
+  // interrupt returns; no need to wake anyone else.
+  if(cpu->idle && (p->cpumask & (1 << cpu->id)))
+    return;
+  for(c = cpus; c < cpus+ncpu; c++){
+    if(c != cpu && c->idle && (p->cpumask & (1 << c->id))){
+      c->idle = 0;
+      lapicipi(c->apicid, T_IRQ0 + IRQ_RESCHED);
+      return;
+    }
+  }
+  if(p->cpumask & (1 << cpu->id))
+    return;
+  for(c = cpus; c < cpus+ncpu; c++){
+    if(p->cpumask & (1 << c->id)){
+      lapicipi(c->apicid, T_IRQ0 + IRQ_RESCHED);
+      return;
+    }
+  }
+}
+
+// Halt until an interrupt arrives.  Called by scheduler()
+// after a scan of ptable found nothing to run and set cpu->idle.
+// kick() clears cpu->idle before sending its IPI, so if idle
+// is still set with interrupts off, the IPI has not been taken
+// yet and will wake the hlt.  The scheduling tick is stopped
+// while halted; only pending timers wake the CPU.  It keeps
+// running while a CPU group is throttled, so that the group's
+// processes are picked up once its period ends.
+static void
+idle(void)
+{
+  int stop;
+
+  cli();
+  if(cpu->idle){
+    rcuqs();
+    countinc(CNT_IDLE);
+    stop = ncgthrottled == 0;
+    if(stop)
+      clocktick(0);
+    stihlt();
+    cli();
+    if(stop)
+      clocktick(1);
+  }
+  cpu->idle = 0;
+}
+
+// p's CPU group, read once: without p->lock, cgfree()
+// may be clearing it.  0 if p has none.
+static struct cgroup*
+cgof(struct proc *p)
+{
+  return *(struct cgroup* volatile*)&p->cg;
+}
+
+// May this CPU run p, found RUNNABLE in a scan for
+// processes left for it (mine) or for any CPU?
+static int
+runnable(struct proc *p, int mine)
+{
+  struct cgroup *g;
+  int w;
+
+  if(p->state != RUNNABLE || !(p->cpumask & (1 << cpu->id)))
+    return 0;
+  if((g = cgof(p)) == 0 || !cgrunnable(g))
+    return 0;
+  w = p->wakecpu;
+  if(mine)
+    return w == cpu->id;
+  return w < 0 || w == cpu->id || !(p->cpumask & (1 << w));
+}
+
+// Lock p, found by an unlocked scan, and check that it is
+// still runnable().  The current process counts as is, since
+// the caller already holds its lock.  A process whose lock
+// another CPU holds sets *busy: it may be RUNNABLE and still
+// switching out.
+static int
+take(struct proc *p, int mine, int *busy)
+{
+  if(p == proc)
+    return 1;
+  if(!tryacquire(&p->lock)){
+    *busy = 1;
+    return 0;
+  }
+  if(!runnable(p, mine)){
+    release(&p->lock);
+    return 0;
+  }
+  return 1;
+}
+
+// Scan round-robin from where this CPU last stopped for the
+// process that runnable() accepts whose CPU group has the
+// least vtime, and return it with its lock held.  If another
+// CPU takes it first, settle for any other.
+static struct proc*
+scan(int mine, int *busy)
+{
+  struct proc *p, *best;
+  struct cgroup *g;
+  uint64 v, bestv;
+  int i, n, bi;
+
+  n = cpu->nextproc;
+  best = 0;
+  bestv = 0;
+  bi = 0;
+  for(i = 0; i < NPROC; i++){
+    p = &ptable.proc[(n + i) % NPROC];
+    if(!runnable(p, mine) || (g = cgof(p)) == 0)
+      continue;
+    v = cgvtime(g);
+    if(best == 0 || v < bestv){
+      best = p;
+      bestv = v;
+      bi = i;
+    }
+  }
+  if(best == 0)
+    return 0;
+  if(!take(best, mine, busy)){
+    for(bi = 0; bi < NPROC; bi++){
+      best = &ptable.proc[(n + bi) % NPROC];
+      if(runnable(best, mine) && take(best, mine, busy))
+        break;
+    }
+    if(bi == NPROC)
+      return 0;
+  }
+  cpu->nextproc = (n + bi + 1) % NPROC;
+  return best;
+}
+
+// Choose a RUNNABLE process that may run on this CPU,
+// those left for it by place() first, and return it
+// with its lock held.  See scan() for *busy.
+static struct proc*
+pickproc(int *busy)
+{
+  struct proc *p;
+
+  *busy = 0;
+  if(cpu->nwake > 0 && (p = scan(1, busy)) != 0)
+    return p;
+  return scan(0, busy);
+}
+
+// Make p the current process on this CPU, just before
+// swtch()ing to it.  Caller must hold p->lock.
+static void
+switchin(struct proc *p)
+{
+  struct schedstat *st;
+  uint64 now;
+
+  proc = p;
+  switchuvm(p);
+  fpuswitch(p);
+  p->state = RUNNING;
+  st = &schedstats[cpu->id].s;
+  now = nsec();
+  st->nswitch++;
+  countinc(CNT_SWITCH);
+  histadd(st->wakelat, now - p->readyat);
+  p->runat = now;
+  p->chargeat = now;
+  if(p->wakecpu >= 0){
+    __sync_fetch_and_sub(&cpus[p->wakecpu].nwake, 1);
+    p->wakecpu = -1;
+  }
+  if(p->wakefrom >= 0){
+    if(p->wakefrom == cpu->id)
+      st->nwakelocal++;
+    else
+      st->nwakeremote++;
+    p->wakefrom = -1;
+  }
+}
+
+// The current process p is about to be switched away from.
+static void
+switchout(struct proc *p)
+{
+  histadd(schedstats[cpu->id].s.slice, nsec() - p->runat);
+  fpuleave(p);
+}
+
+// Finish a swtch() on the new stack by releasing the lock
+// of the process this CPU switched away from, if any.  Only
+// now is its context saved and safe for another CPU to run.
+static void
+switchdone(void)
+{
+  struct proc *prev;
+
+  prev = cpu->prev;
+  cpu->prev = 0;
+  if(prev)
+    release(&prev->lock);
+}
+
 // Per-CPU process scheduler.
 // Each CPU calls scheduler() after setting itself up.
 // Scheduler never returns.  It loops, doing:
 //  - choose a process to run
 //  - swtch to start running that process
-//  - eventually that process transfers control
-//      via swtch back to the scheduler.
+//  - processes switch directly to each other in sched()
+//      until none is left to run, then swtch back here.
+//  - if there was nothing to run, halt until an interrupt.
 void
 scheduler(void)
 {
-  int i = 0;
   struct proc *p;
+  int busy;
+
   for(;;){
-    ++i;
     // Enable interrupts on this processor.
     sti();
-    // Loop over process table looking for process to run.
-    acquire(&ptable.lock);
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->state != RUNNABLE)
-        continue;
-
-      // Switch to chosen process.  It is the process's job
-      // to release ptable.lock and then reacquire it
-      // before jumping back to us.
-      proc = p;
-      switchuvm(p);
-      p->state = RUNNING;
-      swtch(&cpu->scheduler, p->context);
-      switchkvm();
-
-      // Process is done running for now.
-      // It should have changed its p->state before coming back.
-      proc = 0;
+    p = pickproc(&busy);
+    if(p == 0 && !busy){
+      // Announce that we are going idle, then look once more.
+      // A concurrent kick() either sees cpu->idle and sends
+      // an IPI, or made its process RUNNABLE in time for
+      // this scan to find it.
+      cpu->idle = 1;
+      __sync_synchronize();
+      if((p = pickproc(&busy)) != 0 || busy)
+        cpu->idle = 0;
     }
-    release(&ptable.lock);
-
+    if(p){
+      // Switch to chosen process.  It releases its lock
+      // once it is running, and holds it again when it
+      // jumps back to us.
+      switchin(p);
+      swtch(&cpu->scheduler, p->context);
+      switchdone();
+    } else if(!busy)
+      idle();
   }
 }
 
-// Enter scheduler.  Must hold only ptable.lock
-// and have changed proc->state. Saves and restores
+// Switch away from the current process.  Must hold only
+// proc->lock and have changed proc->state.  Picks the next
+// process and switches straight to it, or to the scheduler
+// if there is none.  Saves and restores
 // intena because intena is a property of this
 // kernel thread, not this CPU. It should
 // be proc->intena and proc->ncli, but that would
@@ -326,11 +1043,11 @@ scheduler(void)
 void
 sched(void)
 {
-  int intena;
+  int intena, busy;
+  struct proc *p, *prev;
 
-
-  if(!holding(&ptable.lock))
-    panic("sched ptable.lock");
+  if(!holding(&proc->lock))
+    panic("sched proc->lock");
   if(cpu->ncli != 1)
     panic("sched locks");
   if(proc->state == RUNNING)
@@ -339,7 +1056,30 @@ sched(void)
     panic("sched interruptible");
   intena = cpu->intena;
 
-  swtch(&proc->context, cpu->scheduler);
+  prev = proc;
+  rcuqs();
+  cgcharge(prev);
+  p = pickproc(&busy);
+  if(p == prev){
+    // Yielded with nothing else to run.
+    prev->state = RUNNING;
+    return;
+  }
+  switchout(prev);
+  cpu->prev = prev;
+  if(p){
+    switchin(p);
+    swtch(&prev->context, p->context);
+  } else {
+    proc = 0;
+    cpu->pgdir = 0;
+    switchkvm();
+    swtch(&prev->context, cpu->scheduler);
+  }
+  // Running prev again, switched to by some CPU's
+  // scheduler() or sched(), which made it current
+  // and took its lock for it.
+  switchdone();
   cpu->intena = intena;
 }
 
@@ -347,20 +1087,22 @@ sched(void)
 void
 yield(void)
 {
-  acquire(&ptable.lock);  //DOC: yieldlock
-  proc->state = RUNNABLE;
+  acquire(&proc->lock);  //DOC: yieldlock
+  ready(proc);
   sched();
-  release(&ptable.lock);
+  release(&proc->lock);
 }
 
 // A fork child's very first scheduling by scheduler()
-// will swtch here.  "Return" to user space.
+// or sched() will swtch here.  "Return" to user space.
 void
 forkret(void)
 {
   static int first = 1;
-  // Still holding ptable.lock from scheduler.
-  release(&ptable.lock);
+  // Still holding our own lock from scheduler() or sched(),
+  // and perhaps that of the process sched() switched from.
+  switchdone();
+  release(&proc->lock);
 
   if (first) {
     // Some initialization functions must be run in the context
@@ -386,81 +1128,188 @@ sleep(void *chan, struct spinlock *lk)
   if(lk == 0)
     panic("sleep without lk");
 
-  // Must acquire ptable.lock in order to
-  // change p->state and then call sched.
-  // Once we hold ptable.lock, we can be
-  // guaranteed that we won't miss any wakeup
-  // (wakeup runs with ptable.lock locked),
-  // so it's okay to release lk.
-  if(lk != &ptable.lock){  //DOC: sleeplock0
-    acquire(&ptable.lock);  //DOC: sleeplock1
-    release(lk);
-  }
-
-  // Go to sleep.
+  // Must acquire proc->lock in order to
+  // change proc->state and then call sched.
+  // Going to sleep before releasing lk means
+  // that a wakeup by anyone holding lk,
+  // which takes our lock too, sees us asleep.
+  acquire(&proc->lock);  //DOC: sleeplock1
   proc->chan = chan;
   proc->state = SLEEPING;
+  release(lk);
+
   sched();
 
   // Tidy up.
   proc->chan = 0;
 
   // Reacquire original lock.
-  if(lk != &ptable.lock){  //DOC: sleeplock2
-    release(&ptable.lock);
-    acquire(lk);
-  }
+  release(&proc->lock);
+  acquire(lk);
 }
 
 //PAGEBREAK!
 // Wake up all processes sleeping on chan.
-// The ptable lock must be held.
+// The caller should hold the lock passed to sleep()
+// along with chan, so that the unlocked checks below
+// cannot miss a process on its way to sleep.
 static void
-wakeup1(void *chan)
+wakeup1(void *chan, int sync)
 {
   struct proc *p;
 
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == SLEEPING && p->chan == chan)
-      p->state = RUNNABLE;
+  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
+    if(p->state != SLEEPING || p->chan != chan)
+      continue;
+    acquire(&p->lock);
+    if(p->state == SLEEPING && p->chan == chan){
+      ready(p);
+      place(p, sync);
+      kick(p);
+    }
+    release(&p->lock);
+  }
 }
 
-// Wake up all processes sleeping on chan.
 void
 wakeup(void *chan)
 {
-  acquire(&ptable.lock);
-  wakeup1(chan);
-  release(&ptable.lock);
+  wakeup1(chan, 0);
+}
+
+// Like wakeup(), for a caller that is about to sleep, so
+// that the woken processes may be left for this CPU.
+void
+wakeupsync(void *chan)
+{
+  wakeup1(chan, 1);
 }
 
-// Kill the process with the given pid.
+// Kill the process with the given pid and
+// every other thread in its group.
 // Process won't exit until it returns
 // to user space (see trap in trap.c).
 int
 kill(int pid)
+{
+  struct proc *p, *leader;
+
+  // Holding waitlock keeps p's group from being freed
+  // or changing while its threads are marked.
+  acquire(&waitlock);
+  if((p = findproc(pid)) == 0){
+    release(&waitlock);
+    return -1;
+  }
+  leader = p->leader;
+  release(&p->lock);
+  killgroup(leader);
+  release(&waitlock);
+  return 0;
+}
+
+// Move the process with the given pid (0 for the caller)
+// into CPU group id.  Its later children and threads follow.
+int
+setcgroup(int pid, int id)
 {
   struct proc *p;
+  int r;
 
-  acquire(&ptable.lock);
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->pid == pid){
-      p->killed = 1;
-      // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
-        p->state = RUNNABLE;
-      release(&ptable.lock);
-      return 0;
-    }
+  if(pid == 0)
+    pid = proc->pid;
+  if((p = findproc(pid)) == 0)
+    return -1;
+  r = -1;
+  if(p->state != EMBRYO)
+    r = cgmove(p, id);
+  release(&p->lock);
+  return r;
+}
+
+// Restrict the process with the given pid (0 for the caller)
+// to the CPUs in mask.  Bits for CPUs that are not present are
+// ignored; fail if none remain.  If the caller may no longer run
+// here, give up the CPU so that an allowed one picks it up.
+// Another process running elsewhere moves at its next yield.
+int
+setaffinity(int pid, uint mask)
+{
+  struct proc *p;
+
+  mask &= (1 << ncpu) - 1;
+  if(mask == 0)
+    return -1;
+
+  if(pid == 0)
+    pid = proc->pid;
+  if((p = findproc(pid)) == 0)
+    return -1;
+  p->cpumask = mask;
+  if(p == proc && !(mask & (1 << cpu->id))){
+    ready(proc);
+    kick(proc);
+    sched();
   }
-  release(&ptable.lock);
-  return -1;
+  release(&p->lock);
+  return 0;
+}
+
+// Count an acquiresleep() that found the lock held and
+// then spun until it was free or, if slept, slept for it.
+void
+sleeplockstat(int slept)
+{
+  pushcli();
+  if(slept)
+    schedstats[cpu->id].s.nsleepblock++;
+  else
+    schedstats[cpu->id].s.nsleepspin++;
+  popcli();
+}
+
+// Copy the statistics of the first n CPUs to st, then
+// clear them all if reset is set.  Return the number of CPUs.
+// Unlocked: a CPU switching meanwhile may be half counted.
+int
+schedstat(struct schedstat *st, int n, int reset)
+{
+  int i;
+
+  if(n > ncpu)
+    n = ncpu;
+  for(i = 0; i < n; i++)
+    st[i] = schedstats[i].s;
+  if(reset)
+    memset(schedstats, 0, sizeof(schedstats));
+  return ncpu;
+}
+
+// Return the CPU mask of the process with the given pid
+// (0 for the caller), or -1 if there is no such process.
+int
+getaffinity(int pid)
+{
+  struct proc *p;
+  int mask;
+
+  if(pid == 0)
+    return proc->cpumask;
+  if((p = findproc(pid)) == 0)
+    return -1;
+  mask = p->cpumask;
+  release(&p->lock);
+  return mask;
 }
 
 //PAGEBREAK: 36
 // Print a process listing to console.  For debugging.
 // Runs when user types ^P on console.
-// No lock to avoid wedging a stuck machine further.
+// Takes no spinlocks, to avoid wedging a stuck machine further,
+// but walks the table as an RCU reader: allocproc() does not
+// reuse a slot freed during the walk, so each line shows one
+// process rather than a mix of an old one and its successor.
+// A state read once may still be stale by the time it prints.
 void
 procdump(void)
 {
@@ -473,23 +1322,29 @@ procdump(void)
   [ZOMBIE]    "zombie"
   };
   int i;
+  enum procstate s;
   struct proc *p;
+  struct context *c;
   char *state;
   addr_t pc[10];
 
+  rcureadlock();
   for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->state == UNUSED)
+    s = *(volatile enum procstate*)&p->state;
+    if(s == UNUSED)
       continue;
-    if(p->state >= 0 && p->state < NELEM(states) && states[p->state])
-      state = states[p->state];
+    if(s >= 0 && s < NELEM(states) && states[s])
+      state = states[s];
     else
       state = "???";
     cprintf("%d %s %s", p->pid, state, p->name);
-    if(p->state == SLEEPING){
-      getstackpcs((addr_t*)p->context->ebp+2, pc);
+    c = *(struct context* volatile*)&p->context;
+    if(s == SLEEPING && c){
+      getstackpcs((addr_t*)c->ebp+2, pc);
       for(i=0; i<10 && pc[i] != 0; i++)
         cprintf(" %p", pc[i]);
     }
     cprintf("\n");
   }
+  rcureadunlock();
 }
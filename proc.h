@@ -1,19 +1,32 @@
-// Per-CPU state
+// Per-CPU state.  Each CPU's starts a cache line, which holds
+// the fields only that CPU writes; the fields other CPUs write
+// as well get a line of their own.
 struct cpu {
   uchar id;
   uchar apicid;                // Local APIC ID
   struct context *scheduler;   // swtch() here to enter scheduler
-  struct taskstate ts;         // Used by x86 to find stack for interrupt
-  struct segdesc gdt[NSEGS];   // x86 global descriptor table
-  volatile uint started;       // Has the CPU started?
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
+  struct proc *fpuowner;       // Last process to load the FPU here
+  int nextproc;                // ptable slot where pickproc() resumes
+  struct proc *prev;           // Switched away from, lock still held
+  int inintr;                  // In trap() for an interrupt or exception
+  int llc;                     // Last-level cache domain (see mpinit)
+  pde_t *pgdir;                // User page table in %cr3, or 0
 
   // Cpu-local storage variables; see below
   void *local;
   //struct cpu *cpu;
   //struct proc *proc;           // The currently-running process.
-};
+
+  // Written by other CPUs too (kick(), place()).
+  volatile int idle __attribute__((aligned(CACHELINE)));  // Halted in scheduler() waiting for work
+  int nwake;                   // Woken processes left for this CPU
+  volatile uint started;       // Has the CPU started?
+
+  struct taskstate ts;         // Used by x86 to find stack for interrupt
+  struct segdesc gdt[NSEGS];   // x86 global descriptor table
+} __attribute__((aligned(CACHELINE)));
 
 extern struct cpu cpus[NCPU];
 extern int ncpu;
@@ -57,23 +70,89 @@ struct context {
 
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
-// Per-process state
+// CPU group; see cgroup.c.  Guarded by cglock there.
+struct cgroup {
+  int inuse;
+  int shares;                  // Share weight
+  int nproc;                   // Member processes
+  int throttled;               // Quota used up for this period
+  uint64 quota;                // CPU time per period (ns), 0 if none
+  uint64 period;               // Quota period (ns)
+  uint64 periodend;            // When the current period ends (nsec)
+  uint64 used;                 // CPU time used this period (ns)
+  uint64 usage;                // CPU time used in all (ns)
+  uint64 nthrottled;           // Periods in which the quota ran out
+  uint64 vtime;                // Usage scaled by CG_SHARES/shares
+};
+
+// Per-process state.  The fields used to switch to and from
+// a process and to enter and leave the kernel come first, kstack
+// at offset 0x10 for syscall_entry.  The lock, which other CPUs
+// write when they scan for work, follows on a line of its own,
+// then the fields used only by particular system calls.
 struct proc {
   addr_t sz;                     // Size of process memory (bytes)
   pde_t* pgdir;                // Page table
   char *kstack;                // Bottom of kernel stack for this process
   enum procstate state;        // Process state
   int pid;                     // Process ID
-  struct proc *parent;         // Parent process
   struct trapframe *tf;        // Trap frame for current syscall
   struct context *context;     // swtch() here to run process
   void *chan;                  // If non-zero, sleeping on chan
   int killed;                  // If non-zero, have been killed
+  uint cpumask;                // CPUs allowed to run this process
+  struct proc *leader;         // Thread group leader; owns ofile and cwd
+  addr_t tls;                  // User TLS pointer, loaded into GS base
+  char *fpu;                   // FPU/SSE/AVX save area, 0 until first use
+  int fpucpu;                  // CPU whose registers hold fpu, or -1
+  int wakecpu;                 // CPU a wakeup left this process for, or -1
+  int wakefrom;                // CPU of the process that woke it, or -1
+  uint64 readyat;              // When last made RUNNABLE (nsec)
+  uint64 runat;                // When last switched to (nsec)
+  uint64 chargeat;             // Run time since then not yet charged to cg
+  struct cgroup *cg;           // CPU group
+
+  struct spinlock lock;        // Guards state, chan, killed, cpumask
+
+  struct proc *parent;         // Parent process
+  struct proc *children;       // First child process
+  struct proc *sibling;        // Next child of parent
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  struct proc *nextthread;     // Next thread in leader's group
+  int nthreads;                // Live threads in group (leader only)
+  addr_t ustack;               // User stack passed to clone()
+  struct proc *pidnext;        // Next in pid hash chain
+  uint64 freegp;               // UNUSED: reusable once this grace period ends
 };
 
+// Threads created by clone() share their leader's pgdir, sz,
+// ofile and cwd.  The ofile and cwd in a thread's own struct proc
+// are unused; always go through proc->leader.
+//
+// A leader's threads hang off leader->nextthread, and its child
+// processes (leaders of their own groups) off leader->children,
+// linked through sibling.  Both lists, nthreads and parent are
+// guarded by waitlock in proc.c, which is taken before any p->lock.
+//
+// p->lock guards p's scheduling state.  It is held across every
+// swtch() away from p and released by whatever runs next on that
+// CPU, so a RUNNABLE process whose lock is free has a saved context.
+//
+// Bit i of cpumask allows the process to run on cpus[i].  It is
+// inherited across fork() and clone() and is never empty.
+//
+// When one process wakes another, wakeup() may leave the woken
+// one for an idle CPU sharing the waker's cache, and wakeupsync(),
+// whose caller is about to sleep, for the waker's own CPU, by
+// setting wakecpu.  Other CPUs pass it over until that CPU runs it.
+//
+// Processes with a pid are also on a pid hash chain, which
+// lookups by pid walk under rcureadlock().  A freed slot may
+// still be on some reader's path, so allocproc() does not
+// reuse it until grace period freegp has ended.
+
 // Process memory is laid out contiguously, low addresses first:
 //   text
 //   original data and bss
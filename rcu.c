@@ -0,0 +1,131 @@
+// Read-copy-update.
+//
+// Readers traverse shared structures between rcureadlock()
+// and rcureadunlock() without taking any lock.  Writers still
+// serialize among themselves with a spinlock; one that unlinks
+// an object must not free or reuse it until every reader that
+// might still see it has finished.  rcustart() returns a
+// grace period number for the unlinked object, and rcudone()
+// says whether that grace period has ended, after which the
+// object may be reused.  rcusync() waits for one.
+//
+// A read-side section runs with interrupts off, so it is never
+// preempted and never sleeps.  A CPU is therefore in a
+// quiescent state, outside every section, whenever it takes an
+// interrupt, switches processes or halts idle; rcuqs() notes
+// each of these.  A grace period ends once every CPU that was
+// not idle when it began has passed through a quiescent state.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "spinlock.h"
+#include "proc.h"
+
+static struct {
+  struct spinlock lock;
+  uint64 cur;          // Latest grace period begun
+  volatile uint64 done;  // Latest grace period ended
+  uint64 want;         // Grace period to begin when cur ends
+  uint need;           // CPUs yet to pass a quiescent state in cur
+} rcu;
+
+void
+rcuinit(void)
+{
+  initlock(&rcu.lock, "rcu");
+}
+
+// Begin a grace period.  This CPU is in a quiescent state, as
+// are idle CPUs: an idle CPU that wakes up afterwards can only
+// see what writers left reachable.  Caller holds rcu.lock.
+static void
+gpbegin(void)
+{
+  int i;
+
+  rcu.cur++;
+  rcu.need = 0;
+  for(i = 0; i < ncpu; i++)
+    if(&cpus[i] != cpu && !cpus[i].idle)
+      rcu.need |= 1 << i;
+  if(rcu.need == 0)
+    rcu.done = rcu.cur;
+}
+
+// Enter a read-side section.  Sections may nest and may take
+// spinlocks, but must not sleep.
+void
+rcureadlock(void)
+{
+  pushcli();
+}
+
+void
+rcureadunlock(void)
+{
+  popcli();
+}
+
+// Return a grace period that will not end before every
+// read-side section now in progress has, starting it if
+// need be.  Must not be called inside a read-side section.
+uint64
+rcustart(void)
+{
+  uint64 gp;
+
+  acquire(&rcu.lock);
+  if(rcu.need == 0){
+    gpbegin();
+    gp = rcu.cur;
+  } else {
+    // cur began before the caller's update; wait for the next.
+    gp = rcu.cur + 1;
+    rcu.want = gp;
+  }
+  release(&rcu.lock);
+  return gp;
+}
+
+// Has grace period gp ended?
+int
+rcudone(uint64 gp)
+{
+  return rcu.done >= gp;
+}
+
+// Wait until every read-side section now in progress has ended.
+void
+rcusync(void)
+{
+  uint64 gp;
+
+  gp = rcustart();
+  while(!rcudone(gp))
+    yield();
+}
+
+// This CPU is not in a read-side section.  Interrupts are off.
+void
+rcuqs(void)
+{
+  uint bit;
+
+  bit = 1 << cpu->id;
+  if(!(rcu.need & bit))
+    return;
+  acquire(&rcu.lock);
+  if(rcu.need & bit){
+    rcu.need &= ~bit;
+    if(rcu.need == 0){
+      rcu.done = rcu.cur;
+      if(rcu.want > rcu.cur)
+        gpbegin();
+    }
+  }
+  release(&rcu.lock);
+}
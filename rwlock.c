@@ -0,0 +1,115 @@
+// Reader-writer spinlocks.
+//
+// Each CPU announces that it is reading in its own cache line,
+// so readers on different CPUs never write a shared line and
+// read-mostly tables scale.  A writer takes the embedded
+// spinlock, which orders writers, raises writer, and then waits
+// for every CPU's reader count to drain.  Readers that see
+// writer back off until it is cleared, so writers are preferred
+// and a stream of readers cannot starve them.
+//
+// Like a spinlock, a read or write hold keeps interrupts off;
+// the holder must not sleep and must not take the same lock
+// again, in either mode.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "x86.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "rwlock.h"
+
+void
+initrwlock(struct rwlock *rw, char *name)
+{
+  int i;
+
+  initlock(&rw->lock, name);
+  rw->writer = 0;
+  for(i = 0; i < NCPU; i++)
+    rw->cpu[i].n = 0;
+}
+
+void
+acquireread(struct rwlock *rw)
+{
+  struct rwcpu *c;
+
+  pushcli();
+  c = &rw->cpu[cpu->id];
+  if(c->n || holding(&rw->lock))
+    panic("acquireread");
+  for(;;){
+    c->n = 1;
+    // Announce before looking for a writer; the writer
+    // raises writer before looking for readers.
+    __sync_synchronize();
+    if(!rw->writer)
+      break;
+    c->n = 0;
+    while(rw->writer)
+      pause();
+  }
+}
+
+void
+releaseread(struct rwlock *rw)
+{
+  struct rwcpu *c;
+
+  c = &rw->cpu[cpu->id];
+  if(!c->n)
+    panic("releaseread");
+  // Finish the critical section's loads before a writer can
+  // see this CPU leave.
+  __sync_synchronize();
+  c->n = 0;
+  popcli();
+}
+
+void
+acquirewrite(struct rwlock *rw)
+{
+  int i;
+
+  acquire(&rw->lock);
+  if(rw->cpu[cpu->id].n)
+    panic("acquirewrite");
+  rw->writer = 1;
+  __sync_synchronize();
+  for(i = 0; i < ncpu; i++)
+    while(rw->cpu[i].n)
+      pause();
+}
+
+void
+releasewrite(struct rwlock *rw)
+{
+  if(!holding(&rw->lock))
+    panic("releasewrite");
+  __sync_synchronize();
+  rw->writer = 0;
+  release(&rw->lock);
+}
+
+// Is this CPU reading rw?
+int
+holdingread(struct rwlock *rw)
+{
+  int r;
+
+  pushcli();
+  r = rw->cpu[cpu->id].n;
+  popcli();
+  return r;
+}
+
+// Is this CPU writing rw?
+int
+holdingwrite(struct rwlock *rw)
+{
+  return holding(&rw->lock);
+}
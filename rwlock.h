@@ -0,0 +1,10 @@
+// Reader-writer spinlock.  See rwlock.c.
+struct rwcpu {
+  volatile uint n;   // Is this CPU reading?
+} __attribute__((aligned(CACHELINE)));
+
+struct rwlock {
+  struct spinlock lock;  // Held by the writer; name and debugging
+  volatile uint writer;  // A writer holds the lock or waits for readers
+  struct rwcpu cpu[NCPU];  // Readers, one cache line per CPU
+};
@@ -0,0 +1,63 @@
+// schedstat [cmd [arg...]]
+// Print scheduler statistics.  With a command, clear them,
+// run the command, and print what it accumulated.
+
+#include "types.h"
+#include "stat.h"
+#include "param.h"
+#include "user.h"
+#include "schedstat.h"
+
+struct schedstat st[NCPU];
+
+void
+printhist(char *title, uint64 *h)
+{
+  int b;
+
+  printf(1, "%s\n", title);
+  for(b = 0; b < NSCHEDHIST; b++)
+    if(h[b])
+      printf(1, "  %s2^%d ns: %d\n", b == NSCHEDHIST-1 ? ">=" : "", b, (int)h[b]);
+}
+
+int
+main(int argc, char **argv)
+{
+  int i, b, n, pid;
+  uint64 wakelat[NSCHEDHIST], slice[NSCHEDHIST];
+
+  if(argc > 1){
+    schedstat(st, 0, 1);
+    pid = fork();
+    if(pid < 0){
+      printf(2, "schedstat: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      exec(argv[1], argv+1);
+      printf(2, "schedstat: exec %s failed\n", argv[1]);
+      exit();
+    }
+    waitpid(pid, 0);
+  }
+
+  n = schedstat(st, NCPU, 0);
+  if(n > NCPU)
+    n = NCPU;
+  memset(wakelat, 0, sizeof(wakelat));
+  memset(slice, 0, sizeof(slice));
+  for(i = 0; i < n; i++){
+    printf(1, "cpu%d: %d switches, woken on waker's cpu %d, elsewhere %d\n",
+           i, (int)st[i].nswitch, (int)st[i].nwakelocal, (int)st[i].nwakeremote);
+    printf(1, "  held sleeplocks: spun %d, slept %d\n",
+           (int)st[i].nsleepspin, (int)st[i].nsleepblock);
+    for(b = 0; b < NSCHEDHIST; b++){
+      wakelat[b] += st[i].wakelat[b];
+      slice[b] += st[i].slice[b];
+    }
+  }
+  printhist("wakeup latency:", wakelat);
+  printhist("timeslice:", slice);
+  exit();
+}
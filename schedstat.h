@@ -0,0 +1,13 @@
+#define NSCHEDHIST 32  // log2 buckets; the last also counts longer times
+
+// Per-CPU scheduler statistics, as returned by schedstat().
+// Bucket i of a histogram counts times of 2^i to 2^(i+1)-1 ns.
+struct schedstat {
+  uint64 nswitch;              // Processes switched to
+  uint64 nwakelocal;           // Woken processes run on the waker's CPU
+  uint64 nwakeremote;          // Woken processes run on another CPU
+  uint64 nsleepspin;           // Held sleeplocks got by spinning
+  uint64 nsleepblock;          // Held sleeplocks slept for
+  uint64 wakelat[NSCHEDHIST];  // Time from RUNNABLE to RUNNING
+  uint64 slice[NSCHEDHIST];    // Time RUNNING before switching out
+};
@@ -1,4 +1,10 @@
 // Sleeping locks
+//
+// Most sleeplocks are held only for a moment, less than the
+// two context switches that sleeping for one costs.  So while
+// the holder is running, on another CPU, a waiter spins for
+// up to SPINNS before it sleeps.  A holder that is itself
+// sleeping, say for the disk, will not be quick.
 
 #include "types.h"
 #include "defs.h"
@@ -6,29 +12,64 @@
 #include "x86.h"
 #include "memlayout.h"
 #include "mmu.h"
-#include "proc.h"
 #include "spinlock.h"
+#include "proc.h"
 #include "sleeplock.h"
 
+#define SPINNS 20000  // Longest spin before sleeping (ns)
+
 void
 initsleeplock(struct sleeplock *lk, char *name)
 {
   initlock(&lk->lk, "sleep lock");
   lk->name = name;
   lk->locked = 0;
+  lk->nwait = 0;
   lk->pid = 0;
+  lk->owner = 0;
+}
+
+// Is lk still held by o, and o running?  Racy, but o is a
+// slot in the process table and cannot go away.
+static int
+ownerrunning(struct sleeplock *lk, struct proc *o)
+{
+  return lk->locked && lk->owner == o && o->state == RUNNING;
 }
 
 void
 acquiresleep(struct sleeplock *lk)
 {
+  struct proc *o;
+  uint64 end;
+  int spun, slept;
+
   acquire(&lk->lk);
+  spun = slept = 0;
+  if(lk->locked){
+    end = nsec() + SPINNS;
+    while(lk->locked && (o = lk->owner) != 0 && o != proc &&
+          o->state == RUNNING && nsec() < end){
+      spun = 1;
+      release(&lk->lk);
+      // pause() is a compiler barrier, so each test reloads lk and o.
+      while(ownerrunning(lk, o) && nsec() < end)
+        pause();
+      acquire(&lk->lk);
+    }
+  }
   while (lk->locked) {
+    slept = 1;
+    lk->nwait++;
     sleep(lk, &lk->lk);
+    lk->nwait--;
   }
   lk->locked = 1;
   lk->pid = proc->pid;
+  lk->owner = proc;
   release(&lk->lk);
+  if(spun || slept)
+    sleeplockstat(slept);
 }
 
 void
@@ -37,7 +78,9 @@ releasesleep(struct sleeplock *lk)
   acquire(&lk->lk);
   lk->locked = 0;
   lk->pid = 0;
-  wakeup(lk);
+  lk->owner = 0;
+  if(lk->nwait)
+    wakeup(lk);
   release(&lk->lk);
 }
 
@@ -2,9 +2,11 @@
 struct sleeplock {
   uint locked;       // Is the lock held?
   struct spinlock lk; // spinlock protecting this sleep lock
+  int nwait;         // Processes sleeping for the lock
   
   // For debugging:
   char *name;        // Name of lock.
   int pid;           // Process holding lock
+  struct proc *owner;  // Process holding lock; waiters spin while it runs
 };
 
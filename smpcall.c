@@ -0,0 +1,90 @@
+// Cross-CPU function calls.
+//
+// smpcall() queues a request in the target CPU's mailbox and
+// sends it an IPI.  The target runs the function from its
+// interrupt handler and marks the request done.  Callers must
+// not hold spinlocks: the target might be spinning for one with
+// interrupts off, unable to take the IPI.  While a caller waits,
+// it runs requests sent to it, so two CPUs calling each other
+// do not deadlock.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "x86.h"
+#include "traps.h"
+
+struct callreq {
+  void (*fn)(void*);
+  void *arg;
+  volatile int done;
+  struct callreq *next;
+};
+
+static struct {
+  struct spinlock lock;
+  struct callreq *head;
+} mailbox[NCPU];
+
+void
+smpcallinit(void)
+{
+  int i;
+
+  for(i = 0; i < NCPU; i++)
+    initlock(&mailbox[i].lock, "mailbox");
+}
+
+// Run the requests in this CPU's mailbox.
+// Called with interrupts off, from trap() or smpcall().
+void
+smpcallintr(void)
+{
+  struct callreq *r, *next;
+  int id;
+
+  id = cpu->id;
+  if(mailbox[id].head == 0)
+    return;
+  acquire(&mailbox[id].lock);
+  r = mailbox[id].head;
+  mailbox[id].head = 0;
+  release(&mailbox[id].lock);
+
+  for(; r; r = next){
+    next = r->next;  // r is gone once done is set
+    r->fn(r->arg);
+    __sync_synchronize();
+    r->done = 1;
+  }
+}
+
+// Run fn(arg) on CPU c and wait for it to finish.
+void
+smpcall(int c, void (*fn)(void*), void *arg)
+{
+  struct callreq r;
+
+  pushcli();
+  if(c == cpu->id){
+    fn(arg);
+    popcli();
+    return;
+  }
+  r.fn = fn;
+  r.arg = arg;
+  r.done = 0;
+  acquire(&mailbox[c].lock);
+  r.next = mailbox[c].head;
+  mailbox[c].head = &r;
+  release(&mailbox[c].lock);
+
+  lapicipi(cpus[c].apicid, T_IRQ0 + IRQ_CALLFUNC);
+  while(!r.done)
+    smpcallintr();
+  popcli();
+}
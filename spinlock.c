@@ -1,4 +1,23 @@
 // Mutual exclusion spin locks.
+//
+// A lock's kind, chosen by initlockkind(), decides how
+// waiters queue for it:
+//
+// LK_TAS: waiters read lk->locked until it looks free, then
+// try to xchg it.  Cheap when uncontended, but every release
+// sends all waiters after the same cache line, and whoever
+// wins is arbitrary.
+//
+// LK_TICKET: a waiter takes a ticket with an atomic add and
+// waits for lk->owner to reach it.  Waiters are served in
+// order, but all of them still spin on the lock's line.
+//
+// LK_MCS: a waiter appends a node of its own to a queue with
+// an atomic swap of lk->tail and spins on that node, which its
+// predecessor writes once, when it hands the lock over.
+// Served in order, and a release touches one waiter's line.
+// Each CPU has NMCSNODE nodes, enough for the MCS locks it
+// can hold at once.
 
 #include "types.h"
 #include "defs.h"
@@ -6,15 +25,55 @@
 #include "x86.h"
 #include "memlayout.h"
 #include "mmu.h"
-#include "proc.h"
 #include "spinlock.h"
+#include "proc.h"
+
+#define NMCSNODE 8
+
+struct mcsnode {
+  struct mcsnode *volatile next;  // Waiter queued behind us
+  volatile int locked;            // Set until our turn comes
+  int inuse;
+} __attribute__((aligned(CACHELINE)));
+
+static struct mcsnode mcsnodes[NCPU][NMCSNODE];
 
 void
 initlock(struct spinlock *lk, char *name)
+{
+  initlockkind(lk, name, LK_TAS);
+}
+
+void
+initlockkind(struct spinlock *lk, char *name, int kind)
 {
   lk->name = name;
   lk->locked = 0;
   lk->cpu = 0;
+  lk->kind = kind;
+  lk->next = 0;
+  lk->owner = 0;
+  lk->tail = 0;
+  lk->node = 0;
+  lk->class = lockclass(name);
+}
+
+// Take a free queue node of this CPU's.
+// Interrupts are off, so no one else on this CPU can.
+static struct mcsnode*
+mcsget(void)
+{
+  struct mcsnode *n;
+
+  for(n = mcsnodes[cpu->id]; n < &mcsnodes[cpu->id][NMCSNODE]; n++){
+    if(!n->inuse){
+      n->inuse = 1;
+      n->next = 0;
+      n->locked = 1;
+      return n;
+    }
+  }
+  panic("mcsget");
 }
 
 // Acquire the lock.
@@ -24,13 +83,45 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  struct mcsnode *n, *prev;
+  uint t;
+  uint64 start;
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // The xchg is atomic.
-  while(xchg(&lk->locked, 1) != 0)
-    ;
+  // start notes when a contended acquire began spinning.
+  start = 0;
+  switch(lk->kind){
+  case LK_TICKET:
+    t = __sync_fetch_and_add(&lk->next, 1);
+    if(*(volatile uint*)&lk->owner != t){
+      start = rdtsc();
+      while(*(volatile uint*)&lk->owner != t)
+        pause();
+    }
+    break;
+  case LK_MCS:
+    n = mcsget();
+    prev = __sync_lock_test_and_set(&lk->tail, n);
+    if(prev){
+      start = rdtsc();
+      prev->next = n;
+      while(n->locked)
+        pause();
+    }
+    lk->node = n;
+    break;
+  default:
+    // The xchg is atomic.
+    if(xchg(&lk->locked, 1) != 0){
+      start = rdtsc();
+      while(xchg(&lk->locked, 1) != 0)
+        while(*(volatile uint*)&lk->locked)
+          pause();
+    }
+  }
 
   // Tell the C compiler and the processor to not move loads or stores
   // past this point, to ensure that the critical section's memory
@@ -38,17 +129,64 @@ acquire(struct spinlock *lk)
   __sync_synchronize();
 
   // Record info about lock acquisition for debugging.
+  lk->locked = 1;
   lk->cpu = cpu;
   getcallerpcs(&lk, lk->pcs);
+  lockacquired(lk, start, (addr_t)__builtin_return_address(0));
+}
+
+// Acquire the lock only if it is free.
+// Return 1 if it was acquired, 0 if another CPU holds it.
+int
+tryacquire(struct spinlock *lk)
+{
+  struct mcsnode *n;
+  uint t;
+  int ok;
+
+  pushcli();
+  if(holding(lk))
+    panic("tryacquire");
+
+  switch(lk->kind){
+  case LK_TICKET:
+    t = *(volatile uint*)&lk->owner;
+    ok = __sync_bool_compare_and_swap(&lk->next, t, t+1);
+    break;
+  case LK_MCS:
+    n = mcsget();
+    ok = __sync_bool_compare_and_swap(&lk->tail, 0, n);
+    if(ok)
+      lk->node = n;
+    else
+      n->inuse = 0;
+    break;
+  default:
+    ok = xchg(&lk->locked, 1) == 0;
+  }
+  if(!ok){
+    popcli();
+    return 0;
+  }
+  __sync_synchronize();
+
+  lk->locked = 1;
+  lk->cpu = cpu;
+  getcallerpcs(&lk, lk->pcs);
+  lockacquired(lk, 0, (addr_t)__builtin_return_address(0));
+  return 1;
 }
 
 // Release the lock.
 void
 release(struct spinlock *lk)
 {
+  struct mcsnode *n;
+
   if(!holding(lk))
     panic("release");
 
+  lockreleased(lk);
   lk->pcs[0] = 0;
   lk->cpu = 0;
 
@@ -59,10 +197,32 @@ release(struct spinlock *lk)
   // stores; __sync_synchronize() tells them both not to.
   __sync_synchronize();
 
-  // Release the lock, equivalent to lk->locked = 0.
-  // This code can't use a C assignment, since it might
-  // not be atomic. A real OS would use C atomics here.
-  asm volatile("movl $0, %0" : "+m" (lk->locked) : );
+  switch(lk->kind){
+  case LK_TICKET:
+    lk->locked = 0;
+    __sync_synchronize();
+    *(volatile uint*)&lk->owner = lk->owner + 1;
+    break;
+  case LK_MCS:
+    n = lk->node;
+    lk->node = 0;
+    lk->locked = 0;
+    __sync_synchronize();
+    // No successor in sight: try to empty the queue.  If
+    // one is swapping itself in, wait for it to link up.
+    if(n->next == 0 && !__sync_bool_compare_and_swap(&lk->tail, n, 0))
+      while(n->next == 0)
+        pause();
+    if(n->next)
+      n->next->locked = 0;
+    n->inuse = 0;
+    break;
+  default:
+    // Release the lock, equivalent to lk->locked = 0.
+    // This code can't use a C assignment, since it might
+    // not be atomic. A real OS would use C atomics here.
+    asm volatile("movl $0, %0" : "+m" (lk->locked) : );
+  }
 
   popcli();
 }
@@ -114,6 +274,10 @@ holding(struct spinlock *lock)
 // Pushcli/popcli are like cli/sti except that they are matched:
 // it takes two popcli to undo two pushcli.  Also, if interrupts
 // are off, then pushcli, popcli leaves them off.
+// ncli doubles as the kernel's preemption count: code between
+// pushcli and popcli cannot be preempted, and a timer tick or
+// reschedule IPI that arrives meanwhile is taken by the final
+// popcli's sti, where trap() yields.
 
 void
 pushcli(void)
@@ -1,11 +1,28 @@
 // Mutual exclusion lock.
+// Each lock starts a cache line, and the fields acquire() and
+// release() use fill that line; the call stack goes after.
 struct spinlock {
   uint locked;       // Is the lock held?
 
+  // How waiters queue; see spinlock.c.
+  int kind;          // LK_TAS, LK_TICKET or LK_MCS
+  uint next;         // LK_TICKET: next ticket to hand out
+  uint owner;        // LK_TICKET: ticket now being served
+  struct mcsnode *tail;  // LK_MCS: last waiter in queue, or 0
+  struct mcsnode *node;  // LK_MCS: the holder's queue node
+
+  // For profiling; see lockprof.c.
+  struct lockclass *class;  // Statistics shared by locks of this name
+  uint64 acqat;      // TSC when acquired
+
   // For debugging:
-  char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
+  char *name;        // Name of lock.
   addr_t pcs[10];      // The call stack (an array of program counters)
                      // that locked the lock.
-};
+} __attribute__((aligned(CACHELINE)));
 
+#define LK_TAS     0  // test-and-test-and-set; unfair
+#define LK_TICKET  1  // FIFO, all waiters spin on the lock
+#define LK_MCS     2  // FIFO, each waiter spins on its own node
+#define NLOCKKIND  3
@@ -1,14 +1,45 @@
 #include "types.h"
 #include "x86.h"
+#include "mmu.h"
+
+// The copies and fills below use the string instructions.  On
+// CPUs with enhanced REP MOVSB/STOSB (ERMS) the byte forms run
+// as fast as the quadword ones for any length and alignment, so
+// they do the whole job; otherwise quadwords do the bulk and
+// bytes the tail.
+#define CPUID_ERMS  (1 << 9)   // CPUID.(7,0):EBX
+
+static int erms;
+
+// Called once on the boot CPU, before anything much is copied.
+// Until then the quadword paths are used, which work everywhere.
+void
+stringinit(void)
+{
+  uint a, b, c, d;
+
+  cpuid(0, 0, &a, &b, &c, &d);
+  if(a < 7)
+    return;
+  cpuid(7, 0, &a, &b, &c, &d);
+  erms = (b & CPUID_ERMS) != 0;
+}
 
 void*
 memset(void *dst, int c, uint n)
 {
-  if ((addr_t)dst%4 == 0 && n%4 == 0){
-    c &= 0xFF;
-    stosl(dst, (c<<24)|(c<<16)|(c<<8)|c, n/4);
-  } else
+  uint64 v;
+  uint k;
+
+  if(erms || n < 16){
     stosb(dst, c, n);
+    return dst;
+  }
+  k = -(addr_t)dst & 7;   // align the quadword stores
+  stosb(dst, c, k);
+  v = (uchar)c * 0x0101010101010101ULL;
+  stosq((char*)dst + k, v, (n - k) / 8);
+  stosb((char*)dst + n - (n - k) % 8, c, (n - k) % 8);
   return dst;
 }
 
@@ -19,6 +50,9 @@ memcmp(const void *v1, const void *v2, uint n)
 
   s1 = v1;
   s2 = v2;
+  // Skip equal quadwords; the first unequal byte decides.
+  while(n >= 8 && *(const uint64*)s1 == *(const uint64*)s2)
+    s1 += 8, s2 += 8, n -= 8;
   while(n-- > 0){
     if(*s1 != *s2)
       return *s1 - *s2;
@@ -28,6 +62,22 @@ memcmp(const void *v1, const void *v2, uint n)
   return 0;
 }
 
+// Copy the n bytes below d from those below s, top down,
+// for an overlapping move to a higher address.  Not with
+// std; rep movs: the direction flag would stay set across
+// any interrupt or preemption in the middle, and the C code
+// that ran then expects it clear.
+static void
+copydown(char *d, const char *s, uint n)
+{
+  for(; n >= 8; n -= 8){
+    d -= 8, s -= 8;
+    *(uint64*)d = *(const uint64*)s;
+  }
+  while(n-- > 0)
+    *--d = *--s;
+}
+
 void*
 memmove(void *dst, const void *src, uint n)
 {
@@ -36,15 +86,21 @@ memmove(void *dst, const void *src, uint n)
 
   s = src;
   d = dst;
+  // Whole pages (copyuvm, the log, the buffer cache).
+  if(n == PGSIZE && ((addr_t)s | (addr_t)d) % PGSIZE == 0){
+    movsq(d, s, PGSIZE/8);
+    return dst;
+  }
   if(s < d && s + n > d){
-    s += n;
-    d += n;
-    while(n-- > 0)
-      *--d = *--s;
-  } else
-    while(n-- > 0)
-      *d++ = *s++;
-
+    copydown(d + n, s + n, n);
+    return dst;
+  }
+  if(erms){
+    movsb(d, s, n);
+    return dst;
+  }
+  movsq(d, s, n/8);
+  movsb(d + n - n%8, s + n - n%8, n%8);
   return dst;
 }
 
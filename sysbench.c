@@ -0,0 +1,130 @@
+// sysbench [n]
+// Time some common system calls and file system operations,
+// n times each (default 1000), and print the average cost of
+// each.  Run it under kernels built with different OPT and LTO
+// (see Makefile) to compare them.
+
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+#include "fcntl.h"
+#include "clock.h"
+
+#define CHUNK 64   // Blocks per file, well under MAXFILE
+
+char buf[512];
+char *file = "sysbench.tmp";
+
+long
+now(void)
+{
+  struct timespec t;
+
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1000000000 + t.tv_nsec;
+}
+
+void
+report(char *what, long ns, int n)
+{
+  printf(1, "%s: %d ns\n", what, (int)(ns / n));
+}
+
+int
+xopen(char *path, int mode)
+{
+  int fd;
+
+  if((fd = open(path, mode)) < 0){
+    printf(2, "sysbench: cannot open %s\n", path);
+    exit();
+  }
+  return fd;
+}
+
+// Write, then read back, n blocks, CHUNK to a file.  Only the
+// reads and writes are timed.
+void
+rw(int n)
+{
+  int i, j, fd, m;
+  long t, wns, rns;
+
+  wns = rns = 0;
+  for(i = 0; i < n; i += CHUNK){
+    m = n - i < CHUNK ? n - i : CHUNK;
+    unlink(file);
+    fd = xopen(file, O_CREATE|O_RDWR);
+    t = now();
+    for(j = 0; j < m; j++)
+      write(fd, buf, sizeof(buf));
+    wns += now() - t;
+    close(fd);
+    fd = xopen(file, O_RDONLY);
+    t = now();
+    for(j = 0; j < m; j++)
+      read(fd, buf, sizeof(buf));
+    rns += now() - t;
+    close(fd);
+  }
+  unlink(file);
+  report("write 512", wns, n);
+  report("read 512", rns, n);
+}
+
+int
+main(int argc, char *argv[])
+{
+  int i, n, fd, p[2];
+  long t;
+  char c;
+
+  n = argc > 1 ? atoi(argv[1]) : 1000;
+  if(n <= 0)
+    n = 1000;
+
+  t = now();
+  for(i = 0; i < n; i++)
+    getpid();
+  report("getpid", now() - t, n);
+
+  if(pipe(p) < 0){
+    printf(2, "sysbench: pipe failed\n");
+    exit();
+  }
+  t = now();
+  for(i = 0; i < n; i++){
+    write(p[1], "x", 1);
+    read(p[0], &c, 1);
+  }
+  report("pipe write+read", now() - t, n);
+  close(p[0]);
+  close(p[1]);
+
+  fd = xopen(file, O_CREATE|O_RDWR);
+  close(fd);
+  t = now();
+  for(i = 0; i < n; i++)
+    close(xopen(file, O_RDONLY));
+  report("open+close", now() - t, n);
+  unlink(file);
+
+  t = now();
+  for(i = 0; i < n; i++){
+    close(xopen(file, O_CREATE|O_RDWR));
+    unlink(file);
+  }
+  report("create+unlink", now() - t, n);
+
+  rw(n);
+
+  t = now();
+  for(i = 0; i < n/10 + 1; i++){
+    if(fork() == 0)
+      exit();
+    wait();
+  }
+  report("fork+exit+wait", now() - t, n/10 + 1);
+
+  exit();
+}
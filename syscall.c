@@ -3,9 +3,11 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "x86.h"
 #include "syscall.h"
+#include "counter.h"
 
 // User code makes a system call with INT T_SYSCALL.
 // System call number in %rax.
@@ -112,29 +114,45 @@ argstr(int n, char **pp)
   return fetchstr(addr, pp);
 }
 
-extern addr_t sys_chdir(void);
-extern addr_t sys_close(void);
-extern addr_t sys_dup(void);
-extern addr_t sys_exec(void);
-extern addr_t sys_exit(void);
-extern addr_t sys_fork(void);
-extern addr_t sys_fstat(void);
-extern addr_t sys_getpid(void);
-extern addr_t sys_kill(void);
-extern addr_t sys_link(void);
-extern addr_t sys_mkdir(void);
-extern addr_t sys_mknod(void);
-extern addr_t sys_open(void);
-extern addr_t sys_pipe(void);
-extern addr_t sys_read(void);
-extern addr_t sys_sbrk(void);
-extern addr_t sys_sleep(void);
-extern addr_t sys_unlink(void);
-extern addr_t sys_wait(void);
-extern addr_t sys_write(void);
-extern addr_t sys_uptime(void);
-
-static addr_t (*syscalls[])(void) = {
+extern int sys_chdir(void);
+extern int sys_clone(void);
+extern int sys_close(void);
+extern int sys_dup(void);
+extern int sys_exec(void);
+extern int sys_exit(void);
+extern int sys_fork(void);
+extern int sys_fstat(void);
+extern int sys_futex(void);
+extern int sys_getpid(void);
+extern int sys_join(void);
+extern int sys_kill(void);
+extern int sys_link(void);
+extern int sys_mkdir(void);
+extern int sys_mknod(void);
+extern int sys_open(void);
+extern int sys_pipe(void);
+extern int sys_read(void);
+extern int sys_sbrk(void);
+extern int sys_sleep(void);
+extern int sys_unlink(void);
+extern int sys_wait(void);
+extern int sys_waitpid(void);
+extern int sys_sched_setaffinity(void);
+extern int sys_sched_getaffinity(void);
+extern int sys_clock_gettime(void);
+extern int sys_nanosleep(void);
+extern int sys_schedstat(void);
+extern int sys_cgcreate(void);
+extern int sys_setcgroup(void);
+extern int sys_cgstat(void);
+extern int sys_lockbench(void);
+extern int sys_lockstat(void);
+extern int sys_counters(void);
+extern int sys_membench(void);
+extern int sys_write(void);
+extern int sys_uptime(void);
+
+static int (*syscalls[])(void) = {
 [SYS_fork]    sys_fork,
 [SYS_exit]    sys_exit,
 [SYS_wait]    sys_wait,
@@ -156,6 +174,22 @@ static addr_t (*syscalls[])(void) = {
 [SYS_link]    sys_link,
 [SYS_mkdir]   sys_mkdir,
 [SYS_close]   sys_close,
+[SYS_clone]   sys_clone,
+[SYS_join]    sys_join,
+[SYS_futex]   sys_futex,
+[SYS_waitpid] sys_waitpid,
+[SYS_sched_setaffinity] sys_sched_setaffinity,
+[SYS_sched_getaffinity] sys_sched_getaffinity,
+[SYS_clock_gettime] sys_clock_gettime,
+[SYS_nanosleep] sys_nanosleep,
+[SYS_schedstat] sys_schedstat,
+[SYS_cgcreate] sys_cgcreate,
+[SYS_setcgroup] sys_setcgroup,
+[SYS_cgstat]  sys_cgstat,
+[SYS_lockbench] sys_lockbench,
+[SYS_lockstat] sys_lockstat,
+[SYS_counters] sys_counters,
+[SYS_membench] sys_membench,
 };
 
 void
@@ -164,8 +198,11 @@ syscall(void)
   int num;
 
   num = proc->tf->rax;
+  countinc(CNT_SYSCALL);
   if(num > 0 && num < NELEM(syscalls) && syscalls[num]) {
-    proc->tf->rax = syscalls[num]();
+    // User code has always seen the int result zero-extended;
+    // sbrk() fails with (char*)0xffffffff.
+    proc->tf->rax = (uint)syscalls[num]();
   } else {
     cprintf("%d %s: unknown sys call %d\n",
             proc->pid, proc->name, num);
@@ -20,3 +20,19 @@
 #define SYS_link   19
 #define SYS_mkdir  20
 #define SYS_close  21
+#define SYS_clone  22
+#define SYS_join   23
+#define SYS_futex  24
+#define SYS_waitpid 25
+#define SYS_sched_setaffinity 26
+#define SYS_sched_getaffinity 27
+#define SYS_clock_gettime 28
+#define SYS_nanosleep 29
+#define SYS_schedstat 30
+#define SYS_cgcreate 31
+#define SYS_setcgroup 32
+#define SYS_cgstat 33
+#define SYS_lockbench 34
+#define SYS_lockstat 35
+#define SYS_counters 36
+#define SYS_membench 37
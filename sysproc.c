@@ -2,9 +2,15 @@
 #include "x86.h"
 #include "defs.h"
 #include "date.h"
+#include "clock.h"
+#include "schedstat.h"
+#include "cgroup.h"
+#include "lockstat.h"
+#include "counter.h"
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 
 int
@@ -26,6 +32,169 @@ sys_wait(void)
   return wait();
 }
 
+int
+sys_waitpid(void)
+{
+  int pid, options;
+
+  if(argint(0, &pid) < 0 || argint(1, &options) < 0)
+    return -1;
+  return waitpid(pid, options);
+}
+
+int
+sys_clone(void)
+{
+  addr_t fn, arg, stack, tls;
+
+  if(argaddr(0, &fn) < 0 || argaddr(1, &arg) < 0 ||
+     argaddr(2, &stack) < 0 || argaddr(3, &tls) < 0)
+    return -1;
+  return clone(fn, arg, stack, tls);
+}
+
+int
+sys_join(void)
+{
+  addr_t uaddr;
+  char *stack;
+
+  if(argaddr(0, &uaddr) < 0)
+    return -1;
+  if(uaddr == 0)
+    return join(0);
+  if(argptr(0, &stack, sizeof(addr_t)) < 0)
+    return -1;
+  return join((addr_t*)stack);
+}
+
+int
+sys_futex(void)
+{
+  addr_t addr;
+  int op, val;
+
+  if(argaddr(0, &addr) < 0 || argint(1, &op) < 0 || argint(2, &val) < 0)
+    return -1;
+  return futex(addr, op, val);
+}
+
+int
+sys_sched_setaffinity(void)
+{
+  int pid, mask;
+
+  if(argint(0, &pid) < 0 || argint(1, &mask) < 0)
+    return -1;
+  return setaffinity(pid, mask);
+}
+
+int
+sys_sched_getaffinity(void)
+{
+  int pid;
+
+  if(argint(0, &pid) < 0)
+    return -1;
+  return getaffinity(pid);
+}
+
+int
+sys_schedstat(void)
+{
+  int n, reset;
+  char *st;
+
+  if(argint(1, &n) < 0 || argint(2, &reset) < 0 || n < 0)
+    return -1;
+  if(n > NCPU)
+    n = NCPU;
+  if(argptr(0, &st, n*sizeof(struct schedstat)) < 0)
+    return -1;
+  return schedstat((struct schedstat*)st, n, reset);
+}
+
+int
+sys_lockstat(void)
+{
+  int n, reset;
+  char *st;
+
+  if(argint(1, &n) < 0 || argint(2, &reset) < 0 || n < 0)
+    return -1;
+  if(n > 64)
+    n = 64;
+  if(argptr(0, &st, n*sizeof(struct lockstat)) < 0)
+    return -1;
+  return lockstat((struct lockstat*)st, n, reset);
+}
+
+int
+sys_counters(void)
+{
+  int n, reset;
+  char *st;
+
+  if(argint(1, &n) < 0 || argint(2, &reset) < 0 || n < 0)
+    return -1;
+  if(n > NCOUNTER)
+    n = NCOUNTER;
+  if(argptr(0, &st, n*sizeof(struct counter)) < 0)
+    return -1;
+  return counterstat((struct counter*)st, n, reset);
+}
+
+int
+sys_lockbench(void)
+{
+  int kind, ms;
+
+  if(argint(0, &kind) < 0 || argint(1, &ms) < 0)
+    return -1;
+  return lockbench(kind, ms);
+}
+
+int
+sys_membench(void)
+{
+  int kind, n, ms;
+
+  if(argint(0, &kind) < 0 || argint(1, &n) < 0 || argint(2, &ms) < 0)
+    return -1;
+  return membench(kind, n, ms);
+}
+
+int
+sys_cgcreate(void)
+{
+  int shares, quota, period;
+
+  if(argint(0, &shares) < 0 || argint(1, &quota) < 0 || argint(2, &period) < 0)
+    return -1;
+  return cgcreate(shares, quota, period);
+}
+
+int
+sys_setcgroup(void)
+{
+  int pid, id;
+
+  if(argint(0, &pid) < 0 || argint(1, &id) < 0)
+    return -1;
+  return setcgroup(pid, id);
+}
+
+int
+sys_cgstat(void)
+{
+  int id;
+  struct cgstat *st;
+
+  if(argint(0, &id) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+    return -1;
+  return cgstat(id, st);
+}
+
 int
 sys_kill(void)
 {
@@ -60,32 +229,48 @@ int
 sys_sleep(void)
 {
   int n;
-  uint ticks0;
 
-  if(argint(0, &n) < 0)
+  if(argint(0, &n) < 0 || n < 0)
+    return -1;
+  return ticksleep(n);
+}
+
+// Store the time since boot in *ts.
+int
+sys_clock_gettime(void)
+{
+  int clk;
+  struct timespec *ts;
+  uint64 ns;
+
+  if(argint(0, &clk) < 0 || argptr(1, (void*)&ts, sizeof(*ts)) < 0)
+    return -1;
+  if(clk != CLOCK_MONOTONIC)
     return -1;
-  acquire(&tickslock);
-  ticks0 = ticks;
-  while(ticks - ticks0 < n){
-    if(proc->killed){
-      release(&tickslock);
-      return -1;
-    }
-    sleep(&ticks, &tickslock);
-  }
-  release(&tickslock);
+  ns = nsec();
+  ts->tv_sec = ns / 1000000000;
+  ts->tv_nsec = ns % 1000000000;
   return 0;
 }
 
-// return how many clock tick interrupts have occurred
+int
+sys_nanosleep(void)
+{
+  struct timespec *ts;
+
+  if(argptr(0, (void*)&ts, sizeof(*ts)) < 0)
+    return -1;
+  if(ts->tv_sec < 0 || ts->tv_nsec < 0 || ts->tv_nsec >= 1000000000)
+    return -1;
+  if(ts->tv_sec > 1000000000)
+    return -1;
+  return nanosleep(ts->tv_sec * 1000000000 + ts->tv_nsec);
+}
+
+// return how many clock ticks have elapsed
 // since start.
 int
 sys_uptime(void)
 {
-  uint xticks;
-
-  acquire(&tickslock);
-  xticks = ticks;
-  release(&tickslock);
-  return xticks;
+  return clockticks();
 }
@@ -0,0 +1,21 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+// taskset mask cmd [arg...]
+// Run cmd restricted to the CPUs whose bits are set in mask.
+int
+main(int argc, char **argv)
+{
+  if(argc < 3){
+    printf(2, "usage: taskset mask cmd [arg...]\n");
+    exit();
+  }
+  if(sched_setaffinity(0, atoi(argv[1])) < 0){
+    printf(2, "taskset: bad mask %s\n", argv[1]);
+    exit();
+  }
+  exec(argv[2], argv+2);
+  printf(2, "taskset: exec %s failed\n", argv[2]);
+  exit();
+}
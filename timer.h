@@ -0,0 +1,9 @@
+// Kernel timer, run from the timer interrupt by clock.c.
+struct timer {
+  uint64 expires;          // Tick at which fn runs
+  void (*fn)(void*);       // Called with the CPU's clock lock held
+  void *arg;
+  int cpu;                 // Whose timer wheel holds it
+  struct timer *next;      // Next timer in wheel slot
+  struct timer **pprev;    // Link pointing at this timer; 0 if not pending
+};
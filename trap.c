@@ -3,16 +3,15 @@
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "x86.h"
 #include "traps.h"
-#include "spinlock.h"
+#include "counter.h"
 
 // Interrupt descriptor table (shared by all CPUs).
 uint *idt;
 extern addr_t vectors[];  // in vectors.S: array of 256 entry pointers
-struct spinlock tickslock;
-uint ticks;
 
 static void 
 mkgate(uint *idt, uint n, addr_t kva, uint pl, uint trap) {
@@ -52,20 +51,24 @@ trap(struct trapframe *tf)
       exit();
     proc->tf = tf;
 
+    // The syscall instruction masked interrupts.  Run the
+    // call with them on so that it can be preempted anywhere
+    // it holds no spinlock; syscall_trapret turns them off.
+    sti();
     syscall();
     if(proc->killed)
       exit();
     return;
   }
 
+  cpu->inintr = 1;
+  if(tf->trapno >= T_IRQ0)
+    countinc(CNT_INTR);
   switch(tf->trapno){
   case T_IRQ0 + IRQ_TIMER:
-    if(cpunum() == 0){
-      acquire(&tickslock);
-      ticks++;
-      wakeup(&ticks);
-      release(&tickslock);
-    }
+    // Interrupts were on, so not in an RCU read-side section.
+    rcuqs();
+    clockintr();
     lapiceoi();
     break;
   case T_IRQ0 + IRQ_IDE:
@@ -83,6 +86,15 @@ trap(struct trapframe *tf)
     uartintr();
     lapiceoi();
     break;
+  case T_IRQ0 + IRQ_RESCHED:
+    // Sent by kick().  An idle CPU rescans when this returns
+    // to scheduler(); a busy one yields below.
+    lapiceoi();
+    break;
+  case T_IRQ0 + IRQ_CALLFUNC:
+    smpcallintr();
+    lapiceoi();
+    break;
   case T_IRQ0 + 7:
   case T_IRQ0 + IRQ_SPURIOUS:
     cprintf("cpu%d: spurious interrupt at %x:%x\n",
@@ -90,6 +102,18 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
 
+  case T_DEVICE:
+    // First FPU instruction since this process was switched in.
+    if(proc && (tf->cs&3) == DPL_USER){
+      if(fputrap() < 0){
+        cprintf("pid %d %s: no memory for FPU state--kill proc\n",
+                proc->pid, proc->name);
+        proc->killed = 1;
+      }
+      break;
+    }
+    // fall through
+
   //PAGEBREAK: 13
   default:
     if(proc == 0 || (tf->cs&3) == 0){
@@ -106,6 +130,7 @@ trap(struct trapframe *tf)
             rcr2());
     proc->killed = 1;
   }
+  cpu->inintr = 0;
 
   // Force process exit if it has been killed and is in user space.
   // (If it is still executing in the kernel, let it keep running
@@ -113,10 +138,15 @@ trap(struct trapframe *tf)
   if(proc && proc->killed && (tf->cs&3) == DPL_USER)
     exit();
 
-  // Force process to give up CPU on clock tick.
-  // If interrupts were on while locks held, would need to check nlock.
-  if(proc && proc->state == RUNNING && tf->trapno == T_IRQ0+IRQ_TIMER)
+  // Force process to give up CPU on clock tick or reschedule IPI,
+  // in user space or in the kernel.  Holding a spinlock keeps
+  // interrupts off, so cpu->ncli is always 0 here; a request that
+  // arrives while it is not is taken when popcli() turns them on.
+  if(proc && proc->state == RUNNING && cpu->ncli == 0 &&
+     (tf->trapno == T_IRQ0+IRQ_TIMER || tf->trapno == T_IRQ0+IRQ_RESCHED)){
+    countinc(CNT_PREEMPT);
     yield();
+  }
 
   // Check if the process has been killed since we yielded
   if(proc && proc->killed && (tf->cs&3) == DPL_USER)
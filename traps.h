@@ -34,5 +34,7 @@
 #define IRQ_COM1         4
 #define IRQ_IDE         14
 #define IRQ_ERROR       19
+#define IRQ_CALLFUNC    29      // cross-CPU call IPI; see smpcall.c
+#define IRQ_RESCHED     30      // reschedule IPI, sent by kick()
 #define IRQ_SPURIOUS    31
 
@@ -3,6 +3,7 @@
 #include "fcntl.h"
 #include "user.h"
 #include "x86.h"
+#include "futex.h"
 
 char*
 strcpy(char *s, char *t)
@@ -103,3 +104,31 @@ memmove(void *vdst, void *vsrc, int n)
     *dst++ = *src++;
   return vdst;
 }
+
+// Mutex built on futex().  *m is 0 when unlocked, 1 when
+// locked, and 2 when locked with possible waiters, so an
+// uncontended lock and unlock never enter the kernel.
+// See Drepper, "Futexes Are Tricky".
+void
+mutex_lock(int *m)
+{
+  int c;
+
+  if((c = __sync_val_compare_and_swap(m, 0, 1)) == 0)
+    return;
+  if(c != 2)
+    c = __sync_lock_test_and_set(m, 2);
+  while(c != 0){
+    futex(m, FUTEX_WAIT, 2);
+    c = __sync_lock_test_and_set(m, 2);
+  }
+}
+
+void
+mutex_unlock(int *m)
+{
+  if(__sync_fetch_and_sub(m, 1) != 1){
+    *m = 0;
+    futex(m, FUTEX_WAKE, 1);
+  }
+}
@@ -1,10 +1,16 @@
 struct stat;
 struct rtcdate;
+struct timespec;
+struct schedstat;
+struct cgstat;
+struct lockstat;
+struct counter;
 
 // system calls
 int fork(void);
 int exit(void) __attribute__((noreturn));
 int wait(void);
+int waitpid(int, int);
 int pipe(int*);
 int write(int, void*, int);
 int read(int, void*, int);
@@ -23,6 +29,21 @@ int getpid(void);
 char* sbrk(int);
 int sleep(int);
 int uptime(void);
+int clone(void(*)(void*), void*, void*, void*);
+int join(void**);
+int futex(int*, int, int);
+int sched_setaffinity(int, uint);
+int sched_getaffinity(int);
+int clock_gettime(int, struct timespec*);
+int nanosleep(struct timespec*);
+int schedstat(struct schedstat*, int, int);
+int cgcreate(int, int, int);
+int setcgroup(int, int);
+int cgstat(int, struct cgstat*);
+int lockbench(int, int);
+int lockstat(struct lockstat*, int, int);
+int counters(struct counter*, int, int);
+int membench(int, int, int);
 
 // ulib.c
 int stat(char*, struct stat*);
@@ -37,3 +58,5 @@ void* memset(void*, int, uint);
 void* malloc(uint);
 void free(void*);
 int atoi(const char*);
+void mutex_lock(int*);
+void mutex_unlock(int*);
@@ -7,6 +7,13 @@
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
+#include "futex.h"
+#include "wait.h"
+#include "clock.h"
+#include "schedstat.h"
+#include "lockstat.h"
+#include "counter.h"
+#include "cgroup.h"
 
 char buf[8192];
 char name[3];
@@ -1411,6 +1418,971 @@ forktest(void)
   printf(1, "fork test OK\n");
 }
 
+// clone() threads share memory and open files with their
+// creator, and join() hands back the stack they were given.
+int threadfds[2];
+volatile int threadpid;
+
+void
+threadmain(void *arg)
+{
+  threadpid = getpid();
+  *(int*)arg = 42;
+  close(threadfds[1]);
+  exit();
+}
+
+void
+clonetest(void)
+{
+  char *stack;
+  void *ustack;
+  int pid, val;
+
+  printf(stdout, "clone test\n");
+
+  if(pipe(threadfds) < 0){
+    printf(stdout, "pipe failed\n");
+    exit();
+  }
+  stack = malloc(4096);
+  val = 0;
+  pid = clone(threadmain, &val, stack + 4096, 0);
+  if(pid < 0){
+    printf(stdout, "clone failed\n");
+    exit();
+  }
+  ustack = 0;
+  if(join(&ustack) != pid || ustack != stack + 4096){
+    printf(stdout, "join failed\n");
+    exit();
+  }
+  if(val != 42 || threadpid != pid){
+    printf(stdout, "clone: thread did not share memory\n");
+    exit();
+  }
+  if(write(threadfds[1], "x", 1) >= 0){
+    printf(stdout, "clone: thread did not share files\n");
+    exit();
+  }
+  if(join(0) != -1){
+    printf(stdout, "join: joined a thread twice\n");
+    exit();
+  }
+  close(threadfds[0]);
+  free(stack);
+
+  printf(stdout, "clone test OK\n");
+}
+
+// threads contending on a futex-based mutex
+int futexmutex;
+int futexcount;
+
+void
+futexthread(void *arg)
+{
+  int i;
+
+  for(i = 0; i < 1000; i++){
+    mutex_lock(&futexmutex);
+    futexcount++;
+    mutex_unlock(&futexmutex);
+  }
+  exit();
+}
+
+void
+futextest(void)
+{
+  char *stacks[4];
+  int i, word;
+
+  printf(stdout, "futex test\n");
+
+  word = 1;
+  if(futex(&word, FUTEX_WAIT, 0) != -1){
+    printf(stdout, "futex: waited on changed value\n");
+    exit();
+  }
+  if(futex(&word, FUTEX_WAKE, 1) != 0){
+    printf(stdout, "futex: woke a waiter that does not exist\n");
+    exit();
+  }
+
+  for(i = 0; i < 4; i++){
+    stacks[i] = malloc(4096);
+    if(clone(futexthread, 0, stacks[i] + 4096, 0) < 0){
+      printf(stdout, "clone failed\n");
+      exit();
+    }
+  }
+  for(i = 0; i < 4; i++){
+    if(join(0) < 0){
+      printf(stdout, "join failed\n");
+      exit();
+    }
+  }
+  for(i = 0; i < 4; i++)
+    free(stacks[i]);
+  if(futexcount != 4000){
+    printf(stdout, "futex: count %d, expected 4000\n", futexcount);
+    exit();
+  }
+
+  printf(stdout, "futex test OK\n");
+}
+
+// killing a process takes down all of its threads, so
+// its parent's wait() returns even though they never exit
+void
+spinthread(void *arg)
+{
+  for(;;)
+    (*(volatile int*)arg)++;
+}
+
+void
+killthreadtest(void)
+{
+  int fds[2], pid, i, spins;
+  char c;
+
+  printf(stdout, "kill threads test\n");
+
+  if(pipe(fds) < 0){
+    printf(stdout, "pipe failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    spins = 0;
+    for(i = 0; i < 3; i++){
+      if(clone(spinthread, &spins, (char*)malloc(4096) + 4096, 0) < 0){
+        printf(stdout, "clone failed\n");
+        exit();
+      }
+    }
+    // Block with the threads still spinning.
+    read(fds[0], &c, 1);
+    exit();
+  }
+  sleep(10);
+  if(kill(pid) < 0){
+    printf(stdout, "kill failed\n");
+    exit();
+  }
+  if(wait() != pid){
+    printf(stdout, "kill threads: wait failed\n");
+    exit();
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  printf(stdout, "kill threads test OK\n");
+}
+
+// waitpid() reaps the requested child and honors WNOHANG
+void
+waitpidtest(void)
+{
+  int fds[2], pid1, pid2;
+  char c;
+
+  printf(stdout, "waitpid test\n");
+
+  if(pipe(fds) < 0){
+    printf(stdout, "pipe failed\n");
+    exit();
+  }
+  pid1 = fork();
+  if(pid1 == 0){
+    read(fds[0], &c, 1);
+    exit();
+  }
+  pid2 = fork();
+  if(pid2 == 0)
+    exit();
+  if(pid1 < 0 || pid2 < 0){
+    printf(stdout, "fork failed\n");
+    exit();
+  }
+  if(waitpid(pid1, WNOHANG) != 0){
+    printf(stdout, "waitpid: WNOHANG did not return 0\n");
+    exit();
+  }
+  if(waitpid(pid2, 0) != pid2){
+    printf(stdout, "waitpid: wrong child\n");
+    exit();
+  }
+  write(fds[1], "x", 1);
+  if(waitpid(pid1, 0) != pid1){
+    printf(stdout, "waitpid: wrong child\n");
+    exit();
+  }
+  if(waitpid(pid1, WNOHANG) != -1){
+    printf(stdout, "waitpid: reaped a child twice\n");
+    exit();
+  }
+  close(fds[0]);
+  close(fds[1]);
+
+  printf(stdout, "waitpid test OK\n");
+}
+
+// sched_setaffinity() masks are checked and inherited by fork()
+void
+affinitytest(void)
+{
+  int all, pid;
+
+  printf(stdout, "affinity test\n");
+
+  all = sched_getaffinity(0);
+  if(all <= 0){
+    printf(stdout, "sched_getaffinity failed\n");
+    exit();
+  }
+  if(sched_setaffinity(0, 0) >= 0){
+    printf(stdout, "sched_setaffinity accepted an empty mask\n");
+    exit();
+  }
+  if(sched_setaffinity(0, 1) < 0 || sched_getaffinity(0) != 1){
+    printf(stdout, "sched_setaffinity failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "fork failed\n");
+    exit();
+  }
+  if(pid == 0)
+    exit();
+  // The zombie keeps its mask until it is reaped.
+  if(sched_getaffinity(pid) != 1){
+    printf(stdout, "fork did not inherit the CPU mask\n");
+    exit();
+  }
+  wait();
+  if(sched_setaffinity(0, all) < 0){
+    printf(stdout, "sched_setaffinity failed\n");
+    exit();
+  }
+
+  printf(stdout, "affinity test OK\n");
+}
+
+// nanosleep() sleeps at least as long as asked on the
+// monotonic clock, and rejects a malformed timespec
+void
+clocktest(void)
+{
+  struct timespec t0, t1, req;
+  long ns;
+
+  printf(stdout, "clock test\n");
+
+  if(clock_gettime(CLOCK_MONOTONIC, &t0) < 0){
+    printf(stdout, "clock_gettime failed\n");
+    exit();
+  }
+  req.tv_sec = 0;
+  req.tv_nsec = 2000000;
+  if(nanosleep(&req) < 0){
+    printf(stdout, "nanosleep failed\n");
+    exit();
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  ns = (t1.tv_sec - t0.tv_sec) * 1000000000 + (t1.tv_nsec - t0.tv_nsec);
+  if(ns < req.tv_nsec){
+    printf(stdout, "nanosleep returned early\n");
+    exit();
+  }
+  req.tv_nsec = 1000000000;
+  if(nanosleep(&req) >= 0){
+    printf(stdout, "nanosleep accepted a bad timespec\n");
+    exit();
+  }
+
+  printf(stdout, "clock test OK\n");
+}
+
+// sleep() long enough that the timer has to cascade
+// down the wheel before it fires
+void
+sleeptest(void)
+{
+  int t0, t1;
+
+  printf(stdout, "sleep test\n");
+
+  t0 = uptime();
+  if(sleep(70) < 0){
+    printf(stdout, "sleep failed\n");
+    exit();
+  }
+  t1 = uptime();
+  if(t1 - t0 < 70){
+    printf(stdout, "sleep returned early\n");
+    exit();
+  }
+
+  printf(stdout, "sleep test OK\n");
+}
+
+// SSE registers are inherited by fork() and survive
+// switches between processes that both use them
+void
+fputest(void)
+{
+  int pid, i;
+  uint64 v, want;
+
+  printf(stdout, "fpu test\n");
+
+  want = 0x5555555566666666;
+  asm volatile("movq %0, %%xmm7" : : "r" (want) : "xmm7");
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "fork failed\n");
+    exit();
+  }
+  asm volatile("movq %%xmm7, %0" : "=r" (v));
+  if(pid == 0 && v != want){
+    printf(stdout, "fpu test: fork did not copy xmm7\n");
+    exit();
+  }
+  want = pid == 0 ? 0x1111111122222222 : 0x3333333344444444;
+  for(i = 0; i < 10; i++){
+    asm volatile("movq %0, %%xmm7" : : "r" (want) : "xmm7");
+    sleep(1);
+    asm volatile("movq %%xmm7, %0" : "=r" (v));
+    if(v != want){
+      printf(stdout, "fpu test: xmm7 corrupted\n");
+      exit();
+    }
+  }
+  if(pid == 0)
+    exit();
+  wait();
+
+  printf(stdout, "fpu test OK\n");
+}
+
+// sleeping and waking up shows up in schedstat()
+void
+schedstattest(void)
+{
+  static struct schedstat st[NCPU];
+  uint64 n0, n1;
+  int i, n;
+
+  printf(stdout, "schedstat test\n");
+
+  n = schedstat(st, NCPU, 0);
+  if(n < 1 || n > NCPU){
+    printf(stdout, "schedstat failed\n");
+    exit();
+  }
+  for(n0 = 0, i = 0; i < n; i++)
+    n0 += st[i].nswitch;
+  sleep(1);
+  schedstat(st, NCPU, 0);
+  for(n1 = 0, i = 0; i < n; i++)
+    n1 += st[i].nswitch;
+  if(n1 <= n0){
+    printf(stdout, "schedstat: no switches counted\n");
+    exit();
+  }
+
+  printf(stdout, "schedstat test OK\n");
+}
+
+// Processes talking over pipes wake each other, and the
+// wakeups are counted as same-CPU or cross-CPU.
+void
+wakeaffinetest(void)
+{
+  static struct schedstat st[NCPU];
+  uint64 n0, n1;
+  int i, n, pid, a[2], b[2];
+  char c;
+
+  printf(stdout, "wake affine test\n");
+
+  n = schedstat(st, NCPU, 0);
+  for(n0 = 0, i = 0; i < n && i < NCPU; i++)
+    n0 += st[i].nwakelocal + st[i].nwakeremote;
+  if(pipe(a) < 0 || pipe(b) < 0){
+    printf(stdout, "wake affine: pipe failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "wake affine: fork failed\n");
+    exit();
+  }
+  for(i = 0; i < 200; i++){
+    if(pid == 0){
+      if(read(a[0], &c, 1) != 1 || write(b[1], &c, 1) != 1)
+        break;
+    } else if(write(a[1], &c, 1) != 1 || read(b[0], &c, 1) != 1)
+      break;
+  }
+  if(pid == 0)
+    exit();
+  wait();
+  close(a[0]);
+  close(a[1]);
+  close(b[0]);
+  close(b[1]);
+  if(i != 200){
+    printf(stdout, "wake affine: ping-pong failed\n");
+    exit();
+  }
+  schedstat(st, NCPU, 0);
+  for(n1 = 0, i = 0; i < n && i < NCPU; i++)
+    n1 += st[i].nwakelocal + st[i].nwakeremote;
+  if(n1 <= n0){
+    printf(stdout, "wake affine: no wakeups counted\n");
+    exit();
+  }
+
+  printf(stdout, "wake affine test OK\n");
+}
+
+// A process sharing one CPU with another that spends long
+// stretches in the kernel, forking a large image, still gets
+// to run every few ticks.
+void
+kpreempttest(void)
+{
+  int i, all, pid;
+  struct timespec t0, t1;
+  long gap, maxgap;
+
+  printf(stdout, "kernel preempt test\n");
+
+  all = sched_getaffinity(0);
+  if(sched_setaffinity(0, 1) < 0){
+    printf(stdout, "kpreempt: sched_setaffinity failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "kpreempt: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if(sbrk(4*1024*1024) == (char*)0xffffffff)
+      exit();
+    for(i = 0; i < 20; i++){
+      if((pid = fork()) == 0)
+        exit();
+      if(pid > 0)
+        wait();
+    }
+    exit();
+  }
+
+  maxgap = 0;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  while(waitpid(pid, WNOHANG) == 0){
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    gap = (t1.tv_sec - t0.tv_sec) * 1000000000 + t1.tv_nsec - t0.tv_nsec;
+    if(gap > maxgap)
+      maxgap = gap;
+    t0 = t1;
+  }
+  sched_setaffinity(0, all);
+  if(maxgap > 100000000){
+    printf(stdout, "kpreempt: starved for %d ms\n", (int)(maxgap / 1000000));
+    exit();
+  }
+
+  printf(stdout, "kernel preempt test OK\n");
+}
+
+// A process in a CPU group with a 20% quota gets about that
+// share of a CPU, and the group goes away with its last member.
+void
+cgrouptest(void)
+{
+  int id, pid;
+  struct cgstat st;
+  struct timespec t0, t1;
+  long wall;
+
+  printf(stdout, "cgroup test\n");
+
+  if(cgcreate(0, 0, 0) >= 0 || cgstat(0, &st) < 0 || st.nproc < 1){
+    printf(stdout, "cgroup: bad group accepted or root missing\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "cgroup: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if((id = cgcreate(CG_SHARES, 20000, 100000)) <= 0){
+      printf(stdout, "cgroup: cgcreate failed\n");
+      exit();
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    do {
+      clock_gettime(CLOCK_MONOTONIC, &t1);
+      wall = (t1.tv_sec - t0.tv_sec) * 1000000000 + t1.tv_nsec - t0.tv_nsec;
+    } while(wall < 500000000);
+    if(cgstat(id, &st) < 0 || st.nproc != 1){
+      printf(stdout, "cgroup: cgstat failed\n");
+      exit();
+    }
+    if(st.nthrottled == 0 || st.usage > wall / 2){
+      printf(stdout, "cgroup: used %d ms of %d ms, throttled %d times\n",
+             (int)(st.usage / 1000000), (int)(wall / 1000000), (int)st.nthrottled);
+      exit();
+    }
+    // Moving out frees the group.
+    if(setcgroup(0, 0) < 0 || cgstat(id, &st) >= 0){
+      printf(stdout, "cgroup: group outlived its members\n");
+      exit();
+    }
+    exit();
+  }
+  wait();
+
+  printf(stdout, "cgroup test OK\n");
+}
+
+// Two processes contend for each kind of kernel spinlock
+// (LK_TAS, LK_TICKET, LK_MCS) and for the benchmark's
+// reader-writer lock, and both get it; both also make progress
+// in the false-sharing benchmarks.
+void
+lockbenchtest(void)
+{
+  int kind, pid, n;
+
+  printf(stdout, "lockbench test\n");
+
+  if(lockbench(6, 10) >= 0 || lockbench(0, 0) >= 0){
+    printf(stdout, "lockbench: bad arguments accepted\n");
+    exit();
+  }
+  for(kind = 0; kind < 6; kind++){
+    pid = fork();
+    if(pid < 0){
+      printf(stdout, "lockbench: fork failed\n");
+      exit();
+    }
+    n = lockbench(kind, 20);
+    if(n <= 0){
+      printf(stdout, "lockbench: kind %d failed\n", kind);
+      exit();
+    }
+    if(pid == 0)
+      exit();
+    wait();
+  }
+
+  printf(stdout, "lockbench test OK\n");
+}
+
+// Every lock class shows up in lockstat, the process locks get
+// taken, and a reset clears the counts.
+void
+lockstattest(void)
+{
+  static struct lockstat st[64];
+  int i, n, found;
+
+  printf(stdout, "lockstat test\n");
+
+  n = lockstat(st, 64, 0);
+  if(n <= 0){
+    printf(stdout, "lockstat: no lock classes\n");
+    exit();
+  }
+  if(n > 64)
+    n = 64;
+  found = 0;
+  for(i = 0; i < n; i++){
+    if(strcmp(st[i].name, "proc") == 0 && st[i].nacquire > 0)
+      found = 1;
+    if(st[i].maxhold > st[i].hold || st[i].ncontend > st[i].nacquire){
+      printf(stdout, "lockstat: %s inconsistent\n", st[i].name);
+      exit();
+    }
+  }
+  if(!found){
+    printf(stdout, "lockstat: proc locks never taken\n");
+    exit();
+  }
+
+  lockstat(st, 0, 1);
+  n = lockstat(st, 64, 0);
+  if(n > 64)
+    n = 64;
+  for(i = 0; i < n; i++){
+    if(strcmp(st[i].name, "proc") == 0 && st[i].nacquire > 1000){
+      printf(stdout, "lockstat: reset did not clear counts\n");
+      exit();
+    }
+  }
+
+  printf(stdout, "lockstat test OK\n");
+}
+
+// Lookups that skip locks: kill() by pid finds live processes
+// and not reaped ones, even as their slots are reused at once,
+// and cached names disappear when unlinked.
+void
+rcutest(void)
+{
+  int i, fd, pid;
+  char c;
+
+  printf(stdout, "rcu test\n");
+
+  for(i = 0; i < 100; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(stdout, "rcu: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      for(;;)
+        sleep(1);
+    }
+    if(kill(pid) < 0){
+      printf(stdout, "rcu: kill %d failed\n", pid);
+      exit();
+    }
+    wait();
+    if(kill(pid) == 0){
+      printf(stdout, "rcu: killed reaped %d\n", pid);
+      exit();
+    }
+  }
+
+  if(mkdir("rcud") < 0){
+    printf(stdout, "rcu: mkdir failed\n");
+    exit();
+  }
+  for(i = 0; i < 20; i++){
+    fd = open("rcud/f", O_CREATE|O_RDWR);
+    if(fd < 0){
+      printf(stdout, "rcu: create failed\n");
+      exit();
+    }
+    c = 'a' + i;
+    write(fd, &c, 1);
+    close(fd);
+    fd = open("rcud/f", O_RDONLY);
+    if(fd < 0 || read(fd, &c, 1) != 1 || c != 'a' + i){
+      printf(stdout, "rcu: wrong file\n");
+      exit();
+    }
+    close(fd);
+    if(unlink("rcud/f") < 0){
+      printf(stdout, "rcu: unlink failed\n");
+      exit();
+    }
+    if(open("rcud/f", O_RDONLY) >= 0){
+      printf(stdout, "rcu: unlinked file still found\n");
+      exit();
+    }
+  }
+  if(unlink("rcud") < 0){
+    printf(stdout, "rcu: rmdir failed\n");
+    exit();
+  }
+
+  printf(stdout, "rcu test OK\n");
+}
+
+// Opening a cached name while another process unlinks it and
+// reuses its inode for a different name finds the file or
+// nothing, never the other name's file or a freed inode.
+void
+ncracetest(void)
+{
+  struct stat st;
+  int i, fd, pid, n;
+  char c;
+
+  printf(stdout, "name cache race test\n");
+
+  if(mkdir("ncr") < 0){
+    printf(stdout, "ncrace: mkdir failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(stdout, "ncrace: fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    // Alternate f and g, so that g often gets f's old inode.
+    for(i = 0; i < 400; i++){
+      c = i % 2 ? 'g' : 'f';
+      fd = open(c == 'f' ? "ncr/f" : "ncr/g", O_CREATE|O_RDWR);
+      if(fd < 0){
+        printf(stdout, "ncrace: create failed\n");
+        exit();
+      }
+      write(fd, &c, 1);
+      close(fd);
+      unlink(c == 'f' ? "ncr/f" : "ncr/g");
+    }
+    exit();
+  }
+  for(i = 0; i < 2000; i++){
+    if((fd = open("ncr/f", O_RDONLY)) < 0)
+      continue;
+    if(fstat(fd, &st) < 0 || st.type != T_FILE){
+      printf(stdout, "ncrace: opened a freed inode\n");
+      exit();
+    }
+    n = read(fd, &c, 1);
+    if(n == 1 && c != 'f'){
+      printf(stdout, "ncrace: opened another name's file\n");
+      exit();
+    }
+    close(fd);
+  }
+  wait();
+  if(unlink("ncr") < 0){
+    printf(stdout, "ncrace: rmdir failed\n");
+    exit();
+  }
+
+  printf(stdout, "name cache race test OK\n");
+}
+
+// Processes on several CPUs write through one shared file
+// descriptor at once, so that they contend for its inode lock,
+// and no write is lost.
+void
+sleeplocktest(void)
+{
+  int i, j, n, fd, pid;
+  struct stat st;
+  char buf[8];
+
+  printf(stdout, "sleeplock test\n");
+
+  unlink("slk");
+  fd = open("slk", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(stdout, "sleeplock: create failed\n");
+    exit();
+  }
+  n = schedstat(0, 0, 0);
+  if(n > 4)
+    n = 4;
+  memset(buf, 'x', sizeof(buf));
+  for(i = 0; i < n; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(stdout, "sleeplock: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      sched_setaffinity(0, 1 << i);
+      for(j = 0; j < 50; j++){
+        if(write(fd, buf, sizeof(buf)) != sizeof(buf)){
+          printf(stdout, "sleeplock: write failed\n");
+          exit();
+        }
+      }
+      exit();
+    }
+  }
+  for(i = 0; i < n; i++)
+    wait();
+
+  if(fstat(fd, &st) < 0 || st.size != n*50*sizeof(buf)){
+    printf(stdout, "sleeplock: file size %d\n", st.size);
+    exit();
+  }
+  close(fd);
+  unlink("slk");
+
+  printf(stdout, "sleeplock test OK\n");
+}
+
+// The per-CPU counters, summed, see system calls made on
+// every CPU and the pages a child allocates and frees.
+void
+countertest(void)
+{
+  struct counter a[NCOUNTER], b[NCOUNTER];
+  int i, n, pid;
+
+  printf(stdout, "counter test\n");
+
+  if(counters(a, NCOUNTER, 0) != NCOUNTER){
+    printf(stdout, "counters: wrong count\n");
+    exit();
+  }
+  n = schedstat(0, 0, 0);
+  for(i = 0; i < n && i < 32; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(stdout, "counters: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      sched_setaffinity(0, 1 << i);
+      for(n = 0; n < 100; n++)
+        getpid();
+      exit();
+    }
+    wait();
+  }
+  counters(b, NCOUNTER, 0);
+  if(b[CNT_SYSCALL].value < a[CNT_SYSCALL].value + 100*i ||
+     b[CNT_KALLOC].value <= a[CNT_KALLOC].value ||
+     b[CNT_KFREE].value <= a[CNT_KFREE].value){
+    printf(stdout, "counters: counts missing\n");
+    exit();
+  }
+
+  printf(stdout, "counter test OK\n");
+}
+
+// The kernel's memmove, memset and memcmp agree with the byte
+// loops they replaced (membench checks before it runs), and
+// file data survives copies at odd offsets and lengths.
+void
+membenchtest(void)
+{
+  static char buf[1200], got[1200+9];
+  int fd, i, kind, off, n;
+
+  printf(stdout, "membench test\n");
+
+  if(membench(6, 64, 10) >= 0 || membench(0, 4097, 10) >= 0 ||
+     membench(0, 64, 0) >= 0){
+    printf(stdout, "membench: bad arguments accepted\n");
+    exit();
+  }
+  for(kind = 0; kind < 6; kind++){
+    if(membench(kind, 100, 5) <= 0){
+      printf(stdout, "membench: kind %d failed\n", kind);
+      exit();
+    }
+  }
+
+  for(i = 0; i < sizeof(buf); i++)
+    buf[i] = i * 13 + 1;
+  unlink("membench");
+  fd = open("membench", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(stdout, "membench: create failed\n");
+    exit();
+  }
+  for(off = 0; off < 9; off++){
+    n = sizeof(buf) - 2*off;
+    if(write(fd, buf + off, n) != n){
+      printf(stdout, "membench: write failed\n");
+      exit();
+    }
+  }
+  close(fd);
+  fd = open("membench", O_RDONLY);
+  for(off = 0; off < 9; off++){
+    n = sizeof(buf) - 2*off;
+    if(read(fd, got + 9 - off, n) != n){
+      printf(stdout, "membench: read failed\n");
+      exit();
+    }
+    for(i = 0; i < n; i++){
+      if(got[9 - off + i] != buf[off + i]){
+        printf(stdout, "membench: file data wrong\n");
+        exit();
+      }
+    }
+  }
+  close(fd);
+  unlink("membench");
+
+  printf(stdout, "membench test OK\n");
+}
+
+// Several pairs of processes wake each other through pipes at
+// once, while another sleeps until it is killed.
+void
+wakeuptest(void)
+{
+  int i, j, n, pid, fds[2], a[2], b[2];
+  char c;
+
+  printf(stdout, "wakeup test\n");
+
+  for(i = 0; i < 4; i++){
+    if(pipe(a) < 0 || pipe(b) < 0){
+      printf(stdout, "wakeup: pipe failed\n");
+      exit();
+    }
+    pid = fork();
+    if(pid < 0){
+      printf(stdout, "wakeup: fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      pid = fork();
+      for(j = 0; j < 500; j++){
+        if(pid == 0){
+          if(read(a[0], &c, 1) != 1 || write(b[1], &c, 1) != 1)
+            break;
+        } else if(write(a[1], &c, 1) != 1 || read(b[0], &c, 1) != 1)
+          break;
+      }
+      if(j != 500)
+        printf(stdout, "wakeup: ping-pong stopped at %d\n", j);
+      if(pid > 0)
+        wait();
+      exit();
+    }
+    close(a[0]);
+    close(a[1]);
+    close(b[0]);
+    close(b[1]);
+  }
+
+  if(pipe(fds) < 0){
+    printf(stdout, "wakeup: pipe failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid == 0){
+    read(fds[0], &c, 1);
+    exit();
+  }
+  sleep(1);
+  if(kill(pid) < 0){
+    printf(stdout, "wakeup: kill failed\n");
+    exit();
+  }
+  for(n = 0; wait() >= 0; n++)
+    ;
+  close(fds[0]);
+  close(fds[1]);
+  if(n != 5){
+    printf(stdout, "wakeup: reaped %d children\n", n);
+    exit();
+  }
+
+  printf(stdout, "wakeup test OK\n");
+}
+
 void
 sbrktest(void)
 {
@@ -1793,6 +2765,26 @@ main(int argc, char *argv[])
   dirfile();
   iref();
   forktest();
+  clonetest();
+  futextest();
+  killthreadtest();
+  waitpidtest();
+  affinitytest();
+  clocktest();
+  sleeptest();
+  fputest();
+  schedstattest();
+  wakeaffinetest();
+  wakeuptest();
+  kpreempttest();
+  cgrouptest();
+  lockbenchtest();
+  lockstattest();
+  rcutest();
+  ncracetest();
+  sleeplocktest();
+  countertest();
+  membenchtest();
   bigdir(); // slow
 
   uio();
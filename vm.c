@@ -4,6 +4,7 @@
 #include "x86.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "spinlock.h"
 #include "proc.h"
 #include "elf.h"
 
@@ -60,7 +61,7 @@ seginit(void)
   tss[16] = 0x00680000; // IO Map Base = End of TSS
 
   // point FS smack in the middle of our local storage page
-  wrmsr(0xC0000100, ((uint64) local) + (PGSIZE / 2));
+  wrmsr(MSR_FS_BASE, ((uint64) local) + (PGSIZE / 2));
 
   c = &cpus[cpunum()];
   c->local = local;
@@ -162,7 +163,11 @@ switchuvm(struct proc *p)
     panic("switchuvm: no pgdir");
   tss = (uint*) (((char*) cpu->local) + 1024);
   tss_set_rsp(tss, 0, (addr_t)proc->kstack + KSTACKSIZE);
+  cpu->pgdir = p->pgdir;
   lcr3(v2p(p->pgdir));
+  // The kernel owns FS for per-cpu storage, so user
+  // thread-local storage is addressed through GS.
+  wrmsr(MSR_GS_BASE, p->tls);
   popcli();
 
 }
@@ -328,25 +333,48 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 int
 deallocuvm(pde_t *pgdir, uint64 oldsz, uint64 newsz)
 {
-  pte_t *pte;
-  addr_t a, pa;
-
   if(newsz >= oldsz)
     return oldsz;
+  unmapuvm(pgdir, oldsz, newsz);
+  freeuvm(pgdir, oldsz, newsz);
+  return newsz;
+}
 
-  a = PGROUNDUP(newsz);
-  for(; a  < oldsz; a += PGSIZE){
+// First half of deallocuvm: clear PTE_P on the user pages
+// from newsz up to oldsz, but leave their addresses in the
+// PTEs.  Other CPUs may still reach the pages through their
+// TLBs until they are flushed.
+void
+unmapuvm(pde_t *pgdir, uint64 oldsz, uint64 newsz)
+{
+  pte_t *pte;
+  addr_t a;
+
+  for(a = PGROUNDUP(newsz); a < oldsz; a += PGSIZE){
     pte = walkpgdir(pgdir, (char*)a, 0);
     if(pte && (*pte & PTE_P) != 0){
-      pa = PTE_ADDR(*pte);
-      if(pa == 0)
-        panic("kfree");
-      char *v = P2V(pa);
-      kfree(v);
+      if(PTE_ADDR(*pte) == 0)
+        panic("unmapuvm");
+      *pte &= ~PTE_P;
+    }
+  }
+}
+
+// Second half of deallocuvm: free the pages unmapuvm()
+// unmapped, once no TLB can still hold them.
+void
+freeuvm(pde_t *pgdir, uint64 oldsz, uint64 newsz)
+{
+  pte_t *pte;
+  addr_t a, pa;
+
+  for(a = PGROUNDUP(newsz); a < oldsz; a += PGSIZE){
+    pte = walkpgdir(pgdir, (char*)a, 0);
+    if(pte && (*pte & PTE_P) == 0 && (pa = PTE_ADDR(*pte)) != 0){
+      kfree(P2V(pa));
       *pte = 0;
     }
   }
-  return newsz;
 }
 
 // Free all the pages mapped by, and all the memory used for,
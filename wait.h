@@ -0,0 +1,2 @@
+// waitpid() options
+#define WNOHANG  0x1   // return 0 instead of sleeping if no child has exited
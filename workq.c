@@ -0,0 +1,103 @@
+// Per-CPU work queues.
+//
+// Code that must not sleep or linger, such as an interrupt
+// handler, can hand the rest of its job to a kernel thread with
+// queuework().  Each CPU has a queue and a worker thread bound
+// to it that runs the queued work in order, in process context,
+// where it may sleep and be preempted.  A work item is queued at
+// most once at a time; queueing it again before it starts does
+// nothing, and it may be queued again as soon as it has started.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "spinlock.h"
+#include "proc.h"
+#include "traps.h"
+#include "workq.h"
+
+struct workq {
+  struct spinlock lock;
+  struct work *head;
+  struct work **tail;
+  struct proc *worker;
+} __attribute__((aligned(CACHELINE)));
+
+static struct workq workqs[NCPU];
+
+static void
+worker(void *arg)
+{
+  struct workq *q;
+  struct work *w;
+
+  q = arg;
+  acquire(&q->lock);
+  for(;;){
+    while((w = q->head) == 0)
+      sleep(q, &q->lock);
+    q->head = w->next;
+    if(q->head == 0)
+      q->tail = &q->head;
+    release(&q->lock);
+    __sync_lock_release(&w->queued);
+    w->fn(w->arg);
+    acquire(&q->lock);
+  }
+}
+
+// Start a worker thread for each CPU.
+void
+workqinit(void)
+{
+  struct workq *q;
+  int i;
+
+  for(i = 0; i < ncpu; i++){
+    q = &workqs[i];
+    initlock(&q->lock, "workq");
+    q->tail = &q->head;
+    if((q->worker = kthread("kworker", worker, q, 1 << i)) == 0)
+      panic("workqinit");
+  }
+}
+
+// Queue w to run on CPU c.  Return 0 if it was already
+// queued, else 1.  May be called from an interrupt handler.
+int
+queueworkon(int c, struct work *w)
+{
+  struct workq *q;
+
+  if(__sync_lock_test_and_set(&w->queued, 1))
+    return 0;
+  q = &workqs[c];
+  acquire(&q->lock);
+  w->next = 0;
+  *q->tail = w;
+  q->tail = &w->next;
+  wakeup(q);
+  release(&q->lock);
+  // Queued for this CPU, say by an interrupt handler: have
+  // the running process yield to the worker now rather than
+  // at its next tick.
+  pushcli();
+  if(c == cpu->id && proc && proc != q->worker)
+    lapicipi(cpu->apicid, T_IRQ0 + IRQ_RESCHED);
+  popcli();
+  return 1;
+}
+
+// Queue w to run on this CPU.
+int
+queuework(struct work *w)
+{
+  int c;
+
+  pushcli();
+  c = cpu->id;
+  popcli();
+  return queueworkon(c, w);
+}
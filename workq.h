@@ -0,0 +1,7 @@
+// Deferred work; see workq.c.
+struct work {
+  struct work *next;   // Next in queue
+  void (*fn)(void*);   // Run as fn(arg) by a kernel thread
+  void *arg;
+  uint queued;         // On a queue and not yet started
+};
@@ -1,4 +1,10 @@
 // Routines to let C code use special x86 instructions.
+//
+// Those that read or write memory gcc cannot see, or that other
+// code relies on for ordering (cli and sti around critical
+// sections, pause in spin loops, the control registers), have
+// a "memory" clobber so the optimizer neither caches values
+// across them nor moves loads and stores past them.
 
 static inline uchar
 inb(ushort port)
@@ -36,7 +42,7 @@ outsl(int port, const void *addr, int cnt)
   asm volatile("cld; rep outsl" :
                "=S" (addr), "=c" (cnt) :
                "d" (port), "0" (addr), "1" (cnt) :
-               "cc");
+               "memory", "cc");
 }
 
 static inline void
@@ -57,6 +63,33 @@ stosl(void *addr, int data, int cnt)
                "memory", "cc");
 }
 
+static inline void
+stosq(void *addr, uint64 data, addr_t cnt)
+{
+  asm volatile("cld; rep stosq" :
+               "=D" (addr), "=c" (cnt) :
+               "0" (addr), "1" (cnt), "a" (data) :
+               "memory", "cc");
+}
+
+static inline void
+movsb(void *dst, const void *src, addr_t cnt)
+{
+  asm volatile("cld; rep movsb" :
+               "=D" (dst), "=S" (src), "=c" (cnt) :
+               "0" (dst), "1" (src), "2" (cnt) :
+               "memory", "cc");
+}
+
+static inline void
+movsq(void *dst, const void *src, addr_t cnt)
+{
+  asm volatile("cld; rep movsq" :
+               "=D" (dst), "=S" (src), "=c" (cnt) :
+               "0" (dst), "1" (src), "2" (cnt) :
+               "memory", "cc");
+}
+
 struct segdesc;
 
 static inline void
@@ -72,7 +105,7 @@ lgdt(struct segdesc *p, int size)
 //  pd[5] = (addr_t)p >> 64;
 //  pd[6] = (addr_t)p >> 80;
 
-  asm volatile("lgdt (%0)" : : "r" (pd));
+  asm volatile("lgdt (%0)" : : "r" (pd) : "memory");
 }
 
 struct gatedesc;
@@ -88,13 +121,13 @@ lidt(struct gatedesc *p, int size)
   pd[3] = (addr_t)p >> 32;
   pd[4] = (addr_t)p >> 48;
 
-  asm volatile("lidt (%0)" : : "r" (pd));
+  asm volatile("lidt (%0)" : : "r" (pd) : "memory");
 }
 
 static inline void
 ltr(ushort sel)
 {
-  asm volatile("ltr %0" : : "r" (sel));
+  asm volatile("ltr %0" : : "r" (sel) : "memory");
 }
 
 static inline addr_t
@@ -114,19 +147,37 @@ loadgs(ushort v)
 static inline void
 cli(void)
 {
-  asm volatile("cli");
+  asm volatile("cli" : : : "memory");
 }
 
 static inline void
 sti(void)
 {
-  asm volatile("sti");
+  asm volatile("sti" : : : "memory");
 }
 
 static inline void
 hlt(void)
 {
-  asm volatile("hlt");
+  asm volatile("hlt" : : : "memory");
+}
+
+// Enable interrupts and halt.  sti delays interrupt delivery
+// until after the next instruction, so an interrupt that is
+// already pending wakes the hlt instead of being taken before it.
+static inline void
+stihlt(void)
+{
+  asm volatile("sti; hlt" : : : "memory");
+}
+
+static inline uint64
+rdtsc(void)
+{
+  uint lo, hi;
+
+  asm volatile("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((uint64)hi << 32) | lo;
 }
 
 static inline uint
@@ -138,10 +189,16 @@ xchg(volatile uint *addr, addr_t newval)
   asm volatile("lock; xchgl %0, %1" :
                "+m" (*addr), "=a" (result) :
                "1" (newval) :
-               "cc");
+               "memory", "cc");
   return result;
 }
 
+static inline void
+pause(void)
+{
+  asm volatile("pause" : : : "memory");
+}
+
 static inline addr_t
 rcr2(void)
 {
@@ -153,7 +210,55 @@ rcr2(void)
 static inline void
 lcr3(addr_t val)
 {
-  asm volatile("mov %0,%%cr3" : : "r" (val));
+  asm volatile("mov %0,%%cr3" : : "r" (val) : "memory");
+}
+
+static inline addr_t
+rcr0(void)
+{
+  addr_t val;
+  asm volatile("mov %%cr0,%0" : "=r" (val));
+  return val;
+}
+
+static inline void
+lcr0(addr_t val)
+{
+  asm volatile("mov %0,%%cr0" : : "r" (val) : "memory");
+}
+
+static inline void
+clts(void)
+{
+  asm volatile("clts" : : : "memory");
+}
+
+static inline addr_t
+rcr4(void)
+{
+  addr_t val;
+  asm volatile("mov %%cr4,%0" : "=r" (val));
+  return val;
+}
+
+static inline void
+lcr4(addr_t val)
+{
+  asm volatile("mov %0,%%cr4" : : "r" (val) : "memory");
+}
+
+static inline void
+cpuid(uint leaf, uint subleaf, uint *a, uint *b, uint *c, uint *d)
+{
+  asm volatile("cpuid" :
+               "=a" (*a), "=b" (*b), "=c" (*c), "=d" (*d) :
+               "a" (leaf), "c" (subleaf));
+}
+
+static inline void
+xsetbv(uint reg, uint64 val)
+{
+  asm volatile("xsetbv" : : "c" (reg), "a" ((uint)val), "d" ((uint)(val >> 32)));
 }
 
 //PAGEBREAK: 36